@@ -0,0 +1,518 @@
+#include "benchmark.hpp"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "environment.hpp"
+#include "garbage_collection.hpp"
+#include "heap.hpp"
+#include "evaluate.hpp"
+#include "memory.hpp"
+#include "parse.hpp"
+#include "scheme.hpp"
+#include "vm.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace scm {
+
+// results are written here so the compiler can't optimise the measured work away
+static volatile std::uintptr_t benchmarkSink;
+
+/**
+ * Run a piece of code a number of times and measure the average duration.
+ * @tparam FUNC a callable without arguments
+ * @param iterations how often to run the code
+ * @param body the code to measure
+ * @returns the average duration of a single run in nanoseconds
+ */
+template <typename FUNC>
+double measureNanoseconds(long iterations, FUNC body)
+{
+  auto start{std::chrono::steady_clock::now()};
+  for (long i{0}; i < iterations; i++) {
+    body();
+  }
+  auto end{std::chrono::steady_clock::now()};
+  std::chrono::duration<double, std::nano> duration{end - start};
+  return duration.count() / static_cast<double>(iterations);
+}
+
+/**
+ * Count the mispredicted branches of running a piece of code once, with a hardware counter of
+ * the kernel. Only available on Linux, and only if the kernel allows unprivileged processes to
+ * use performance counters.
+ * @tparam FUNC a callable without arguments
+ * @param body the code to measure, it runs even if there's no counter
+ * @returns the number of mispredicted branches, -1 if there's no counter
+ */
+template <typename FUNC>
+long countBranchMisses(FUNC body)
+{
+#if defined(__linux__)
+  perf_event_attr attributes{};
+  attributes.size = sizeof(attributes);
+  attributes.type = PERF_TYPE_HARDWARE;
+  attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+  attributes.disabled = 1;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  auto counter{static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0))};
+  if (counter >= 0) {
+    ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    body();
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+    long long misses{-1};
+    if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) {
+      misses = -1;
+    }
+    close(counter);
+    return static_cast<long>(misses);
+  }
+#endif
+  body();
+  return -1;
+}
+
+/**
+ * Print a single benchmark result.
+ * @param name what was measured
+ * @param value the measured value
+ * @param unit the unit of the value
+ */
+static void printResult(const std::string& name, double value, const std::string& unit)
+{
+  std::cout << "  " << std::left << std::setw(48) << name << std::right << std::setw(10)
+            << std::fixed << std::setprecision(2) << value << ' ' << unit << '\n';
+}
+
+/**
+ * Measure the cost of variable lookups against the top level environment, which holds all
+ * builtins plus everything defined in std.scm. As a baseline, the same bindings are looked up in
+ * a std::map<std::string, Object*>, which is how environments used to store them. Resolved
+ * lambda bodies skip the lookup altogether and load the value from the cell of the variable.
+ * @param env the top level environment
+ */
+static void benchmarkEnvironmentLookup(Environment& env)
+{
+  std::vector<Binding> bindings{getBindings(env)};
+  std::map<std::string, Object*> baseline;
+  for (Binding& binding : bindings) {
+    baseline[getStringValue(binding.key)] = binding.value;
+  }
+  // a chain of frames as it would exist four calls deep
+  Environment frame1{&env}, frame2{&frame1}, frame3{&frame2}, frame4{&frame3};
+  constexpr long rounds{20000};
+  long iterations{rounds * static_cast<long>(bindings.size())};
+
+  std::cout << "environment lookup (" << bindings.size() << " top level bindings)\n";
+  double nsMap{measureNanoseconds(rounds, [&bindings, &baseline]() {
+    for (Binding& binding : bindings) {
+      // the old implementation copied the symbol name before every lookup
+      std::string key{getStringValue(binding.key)};
+      benchmarkSink = reinterpret_cast<std::uintptr_t>(baseline.find(key)->second);
+    }
+  })};
+  printResult("std::map<std::string> lookup", nsMap * rounds / iterations, "ns/lookup");
+  double nsTable{measureNanoseconds(rounds, [&bindings, &env]() {
+    for (Binding& binding : bindings) {
+      benchmarkSink = reinterpret_cast<std::uintptr_t>(getVariable(env, binding.key));
+    }
+  })};
+  printResult("hash table lookup, top level", nsTable * rounds / iterations, "ns/lookup");
+  double nsNested{measureNanoseconds(rounds, [&bindings, &frame4]() {
+    for (Binding& binding : bindings) {
+      benchmarkSink = reinterpret_cast<std::uintptr_t>(getVariable(frame4, binding.key));
+    }
+  })};
+  printResult("hash table lookup, 4 frames deep", nsNested * rounds / iterations, "ns/lookup");
+  // resolved lambda bodies hold the cells of global variables, see resolve.cpp
+  std::vector<Object*> cells;
+  for (Binding& binding : bindings) {
+    cells.push_back(getGlobalCellOf(frame4, binding.key));
+  }
+  double nsCell{measureNanoseconds(rounds, [&cells]() {
+    for (Object* cell : cells) {
+      benchmarkSink = reinterpret_cast<std::uintptr_t>(getGlobalCell(cell).value);
+    }
+  })};
+  printResult("global cell load, any depth", nsCell * rounds / iterations, "ns/lookup");
+}
+
+/**
+ * Measure a full collection after a growing number of unreachable cons cells was allocated.
+ * The cost per cell should stay the same no matter how many cells die at once.
+ */
+static void benchmarkSweep()
+{
+  std::cout << "garbage collection of unreachable cons cells\n";
+  for (long nCells : {10000L, 100000L, 1000000L}) {
+    for (long i{0}; i < nCells; i++) {
+      newCons(newInteger(static_cast<int>(i)), SCM_NIL);
+    }
+    double ns{measureNanoseconds(1, []() { collectGarbage(); })};
+    printResult("collect " + std::to_string(nCells) + " dead cells", ns / nCells, "ns/cell");
+  }
+}
+
+/**
+ * Measure a full collection while a huge list or a deeply nested structure is reachable.
+ * Marking uses an explicit mark stack, neither of them may overflow the native stack.
+ * @param env the top level environment
+ */
+static void benchmarkMarkLargeStructures(Environment& env)
+{
+  std::cout << "garbage collection of reachable structures\n";
+  Object* symbol{newSymbol("benchmark-data")};
+  for (long nCells : {1000000L, 4000000L}) {
+    Object* list{SCM_NIL};
+    for (long i{0}; i < nCells; i++) {
+      list = newCons(newInteger(static_cast<int>(i)), list);
+    }
+    define(env, symbol, list);
+    double ns{measureNanoseconds(1, []() { collectGarbage(); })};
+    printResult("collect list of " + std::to_string(nCells) + " cells", ns / nCells, "ns/cell");
+    define(env, symbol, SCM_NIL);
+    collectGarbage();
+  }
+  constexpr long depth{1000000};
+  Object* nested{SCM_NIL};
+  for (long i{0}; i < depth; i++) {
+    nested = newCons(nested, SCM_NIL);
+  }
+  define(env, symbol, nested);
+  double ns{measureNanoseconds(1, []() { collectGarbage(); })};
+  printResult("collect " + std::to_string(depth) + " nested lists", ns / depth, "ns/cell");
+  define(env, symbol, SCM_NIL);
+  collectGarbage();
+}
+
+/**
+ * Compare a collection of the young generation with a full collection while a large structure is
+ * alive. The structure is promoted to the old generation first, so only the full collection has
+ * to mark it.
+ * @param env the top level environment, the structure is bound in it while measuring
+ */
+static void benchmarkGenerations(Environment& env)
+{
+  std::cout << "generational garbage collection\n";
+  constexpr long nLive{1000000};
+  constexpr long nGarbage{10000};
+  Object* symbol{newSymbol("benchmark-data")};
+  Object* list{SCM_NIL};
+  for (long i{0}; i < nLive; i++) {
+    list = newCons(newInteger(static_cast<int>(i)), list);
+  }
+  define(env, symbol, list);
+  collectGarbage();
+  auto allocateGarbage = []() {
+    for (long i{0}; i < nGarbage; i++) {
+      newCons(SCM_NIL, SCM_NIL);
+    }
+  };
+  allocateGarbage();
+  double ns{measureNanoseconds(1, []() { collectYoungGeneration(); })};
+  printResult("young generation, " + std::to_string(nLive) + " old cells", ns / 1e6, "ms");
+  allocateGarbage();
+  ns = measureNanoseconds(1, []() { collectGarbage(); });
+  printResult("full collection, " + std::to_string(nLive) + " old cells", ns / 1e6, "ms");
+  define(env, symbol, SCM_NIL);
+  collectGarbage();
+}
+
+/**
+ * Measure the pause of a full collection marking with a growing number of threads. The structure
+ * is a list of many long lists, so there's enough independent work to share between threads.
+ * @param env the top level environment, the structure is bound in it while measuring
+ */
+static void benchmarkParallelMarking(Environment& env)
+{
+  std::cout << "parallel marking, " << std::thread::hardware_concurrency()
+            << " hardware threads available\n";
+  constexpr long nLists{256};
+  constexpr long listLength{16000};
+  Object* symbol{newSymbol("benchmark-data")};
+  Object* lists{SCM_NIL};
+  for (long i{0}; i < nLists; i++) {
+    Object* list{SCM_NIL};
+    for (long j{0}; j < listLength; j++) {
+      list = newCons(newInteger(static_cast<int>(j)), list);
+    }
+    lists = newCons(list, lists);
+  }
+  define(env, symbol, lists);
+  collectGarbage();
+  int previousThreads{setMarkingThreads(1)};
+  for (int nThreads : {1, 2, 4, 8}) {
+    setMarkingThreads(nThreads);
+    double ns{measureNanoseconds(1, []() { collectGarbage(); })};
+    printResult("collect " + std::to_string(nLists * listLength) + " cells, " +
+                    std::to_string(nThreads) + " threads",
+                ns / 1e6,
+                "ms");
+  }
+  setMarkingThreads(previousThreads);
+  define(env, symbol, SCM_NIL);
+  collectGarbage();
+}
+
+/**
+ * Measure walking a list whose cells are scattered over the heap, before and after a collection
+ * that compacts cons cells. The list is built along with several others in random order, the
+ * others are garbage afterwards and leave gaps of random size between its cells.
+ * @param env the top level environment, the list is bound in it while measuring
+ */
+static void benchmarkCompaction(Environment& env)
+{
+  std::cout << "list traversal before and after compaction\n";
+  constexpr long listLength{500000};
+  constexpr std::size_t nLists{8};
+  Object* symbol{newSymbol("benchmark-data")};
+  std::vector<Object*> lists(nLists, SCM_NIL);
+  std::mt19937 random{42};
+  for (long nCells{0}; nCells < listLength;) {
+    std::size_t list{random() % nLists};
+    lists[list] = newCons(newInteger(static_cast<int>(nCells)), lists[list]);
+    nCells += list == 0 ? 1 : 0;
+  }
+  define(env, symbol, lists[0]);
+  collectGarbage();
+  // the list is looked up again every time, as the compaction moves its cells
+  auto traverse = [&env, symbol]() {
+    long sum{0};
+    for (Object* cell{getVariable(env, symbol)}; cell != SCM_NIL; cell = getCdr(cell)) {
+      sum += getIntValue(getCar(cell));
+    }
+    benchmarkSink = static_cast<std::uintptr_t>(sum);
+  };
+  double ns{measureNanoseconds(10, traverse)};
+  printResult("walk scattered list of " + std::to_string(listLength) + " cells",
+              ns / listLength,
+              "ns/cell");
+  bool previousCompaction{setConsCompaction(true)};
+  ns = measureNanoseconds(1, []() { collectGarbage(); });
+  setConsCompaction(previousCompaction);
+  printResult("compacting collection", ns / 1e6, "ms");
+  ns = measureNanoseconds(10, traverse);
+  printResult("walk compacted list of " + std::to_string(listLength) + " cells",
+              ns / listLength,
+              "ns/cell");
+  define(env, symbol, SCM_NIL);
+  collectGarbage();
+}
+
+#if defined(__linux__)
+/**
+ * Get the amount of memory the process has written to and doesn't share with any other process.
+ * @returns the private dirty memory in kilobytes
+ */
+static long getPrivateDirtyKilobytes()
+{
+  std::ifstream rollup{"/proc/self/smaps_rollup"};
+  long total{0};
+  for (std::string field; rollup >> field;) {
+    long kilobytes;
+    if (field == "Private_Dirty:" && rollup >> kilobytes) {
+      total += kilobytes;
+    }
+  }
+  return total;
+}
+#endif
+
+/**
+ * Measure how much of the heap a forked process copies when it collects garbage. Mark bits are
+ * kept outside the objects, so the pages of surviving objects should stay shared with the parent.
+ * Only available on Linux, where the sharing can be read from /proc.
+ * @param env the top level environment, the structure is bound in it while measuring
+ */
+static void benchmarkForkSharing(Environment& env)
+{
+#if defined(__linux__)
+  std::cout << "collection in a forked process\n" << std::flush;
+  constexpr long nCells{1000000};
+  Object* symbol{newSymbol("benchmark-data")};
+  Object* list{SCM_NIL};
+  for (long i{0}; i < nCells; i++) {
+    list = newCons(newInteger(static_cast<int>(i)), list);
+  }
+  define(env, symbol, list);
+  collectGarbage();
+  pid_t child{fork()};
+  if (child == 0) {
+    long before{getPrivateDirtyKilobytes()};
+    collectGarbage();
+    printResult("copied by a collection of " + std::to_string(nCells) + " cells",
+                static_cast<double>(getPrivateDirtyKilobytes() - before),
+                "kB");
+    std::cout << std::flush;
+    _exit(0);
+  }
+  waitpid(child, NULL, 0);
+  define(env, symbol, SCM_NIL);
+  collectGarbage();
+#else
+  (void)env;
+#endif
+}
+
+/**
+ * Measure the memory held by the heap before, during and after a spike in allocations. Once the
+ * spike is garbage, the chunks it occupied should be handed back to the operating system.
+ * @param env the top level environment, the spike is bound in it while it's alive
+ */
+static void benchmarkHeapShrinking(Environment& env)
+{
+  std::cout << "heap size around an allocation spike\n";
+  constexpr long nCells{2000000};
+  collectGarbage();
+  printResult("before the spike", static_cast<double>(heap::getMappedBytes()) / 1e6, "MB");
+  Object* symbol{newSymbol("benchmark-data")};
+  Object* list{SCM_NIL};
+  for (long i{0}; i < nCells; i++) {
+    list = newCons(newInteger(static_cast<int>(i)), list);
+  }
+  define(env, symbol, list);
+  collectGarbage();
+  printResult("holding " + std::to_string(nCells) + " cells",
+              static_cast<double>(heap::getMappedBytes()) / 1e6,
+              "MB");
+  define(env, symbol, SCM_NIL);
+  double ns{measureNanoseconds(1, []() { collectGarbage(); })};
+  printResult("after the spike", static_cast<double>(heap::getMappedBytes()) / 1e6, "MB");
+  printResult("collection releasing the spike", ns / 1e6, "ms");
+}
+
+/**
+ * A scheme program to measure, see benchmarkEvaluation.
+ */
+struct BenchmarkProgram {
+  std::string name;
+  std::string source;
+  long iterations;
+};
+
+/**
+ * Compare the two evaluation engines: the trampoline walking the cons tree of an expression and
+ * the virtual machine running the bytecode it's compiled to. The time of the virtual machine
+ * includes compiling the expression. The parsed expression is bound in the top level
+ * environment while it's measured, so the collector doesn't free it in between two runs.
+ * @param env the top level environment, set up with std.scm
+ */
+static void benchmarkEvaluation(Environment& env)
+{
+  const std::vector<BenchmarkProgram> programs{
+      {"(fib 15)", "(fib 15)", 20},
+      {"tail call loop, 10000 calls",
+       "(begin (define (count n) (if (= n 0) n (count (- n 1)))) (count 10000))",
+       20},
+      {"1000 calls, 16 variable references each",
+       "(begin (define (refs n) (if (= n 0) n (begin n n n n n n n n n n n n n n n n "
+       "(refs (- n 1))))) (refs 1000))",
+       200},
+  };
+  Object* symbol{newSymbol("benchmark-expression")};
+  bool wasEnabled{vm::isEnabled()};
+  std::cout << "evaluation engines\n";
+  for (const BenchmarkProgram& program : programs) {
+    std::stringstream stream{program.source};
+    define(env, symbol, readInput(&stream));
+    double ns[2];
+    for (bool useVirtualMachine : {false, true}) {
+      vm::setEnabled(useVirtualMachine);
+      ns[useVirtualMachine] = measureNanoseconds(program.iterations, [&env, symbol]() {
+        Object* result{trampoline::evaluateExpression(env, getVariable(env, symbol))};
+        benchmarkSink = reinterpret_cast<std::uintptr_t>(result);
+      });
+    }
+    printResult(program.name + ", trampoline", ns[0] / 1e3, "us");
+    printResult(program.name + ", vm", ns[1] / 1e3, "us");
+    printResult("speedup", ns[0] / ns[1], "x");
+  }
+  vm::setEnabled(wasEnabled);
+  define(env, symbol, SCM_NIL);
+}
+
+/**
+ * Compare the two ways the virtual machine dispatches instructions: a single switch, and
+ * threaded dispatch, which jumps from the end of one instruction straight to the next one.
+ * Both the time and, where performance counters are available, the mispredicted branches
+ * of a run are measured.
+ * @param env the top level environment, set up with std.scm
+ */
+static void benchmarkDispatch(Environment& env)
+{
+  const std::vector<BenchmarkProgram> programs{
+      {"(fib 15)", "(fib 15)", 20},
+      {"(for-loop 0 1000 ...)", "(for-loop 0 1000 (lambda (i) i))", 200},
+  };
+  Object* symbol{newSymbol("benchmark-expression")};
+  bool wasEnabled{vm::isEnabled()};
+  // threaded dispatch is the default wherever it's supported
+  bool isSupported{vm::setThreadedDispatch(true)};
+  vm::setEnabled(true);
+  bool hasCounters{false};
+  std::cout << "vm dispatch\n";
+  if (!isSupported) {
+    std::cout << "  threaded dispatch isn't supported by this compiler\n";
+  }
+  for (const BenchmarkProgram& program : programs) {
+    std::stringstream stream{program.source};
+    define(env, symbol, readInput(&stream));
+    auto run{[&env, symbol]() {
+      Object* result{trampoline::evaluateExpression(env, getVariable(env, symbol))};
+      benchmarkSink = reinterpret_cast<std::uintptr_t>(result);
+    }};
+    for (bool threaded : {false, true}) {
+      if (vm::setThreadedDispatch(threaded) != threaded) {
+        continue;
+      }
+      std::string name{program.name + (threaded ? ", threaded" : ", switch")};
+      printResult(name, measureNanoseconds(program.iterations, run) / 1e3, "us");
+      long misses{countBranchMisses(run)};
+      if (misses >= 0) {
+        printResult(name, static_cast<double>(misses), "branch misses");
+      }
+      hasCounters = misses >= 0;
+    }
+  }
+  if (!hasCounters) {
+    std::cout << "  branch misses aren't counted, no performance counters are available\n";
+  }
+  vm::setThreadedDispatch(isSupported);
+  vm::setEnabled(wasEnabled);
+  define(env, symbol, SCM_NIL);
+}
+
+/**
+ * Run all micro benchmarks and print their results.
+ * @param env the top level environment, set up with all builtins and std.scm
+ */
+void runBenchmarks(Environment& env)
+{
+  benchmarkEnvironmentLookup(env);
+  benchmarkEvaluation(env);
+  benchmarkDispatch(env);
+  benchmarkSweep();
+  benchmarkMarkLargeStructures(env);
+  benchmarkGenerations(env);
+  benchmarkParallelMarking(env);
+  benchmarkCompaction(env);
+  benchmarkForkSharing(env);
+  benchmarkHeapShrinking(env);
+}
+
+}  // namespace scm
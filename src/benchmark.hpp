@@ -0,0 +1,9 @@
+#pragma once
+#include "environment.hpp"
+#include "scheme.hpp"
+
+namespace scm {
+
+void runBenchmarks(Environment& env);
+
+}  // namespace scm
@@ -0,0 +1,414 @@
+#include "compile.hpp"
+#include <algorithm>
+#include <loguru.hpp>
+#include <vector>
+#include "environment.hpp"
+#include "memory.hpp"
+#include "resolve.hpp"
+#include "scheme.hpp"
+
+namespace scm {
+
+/**
+ * The state of compiling a single lambda body or top level expression.
+ */
+struct Compilation {
+  BytecodeValue code;
+  // the environment the code will run in or descend from, syntax is looked up in it
+  Environment& env;
+  // lambdas created by top level code have to be resolved, all others were resolved with them
+  bool resolvesLambdas;
+};
+
+/**
+ * Append an instruction to the code.
+ * @param compilation the code being compiled
+ * @param op the instruction
+ * @param operand its operand, patched later on for jumps
+ * @returns the index of the instruction
+ */
+static int emit(Compilation& compilation, OpCode op, int operand = 0)
+{
+  compilation.code.instructions.push_back({op, operand});
+  return static_cast<int>(compilation.code.instructions.size()) - 1;
+}
+
+/**
+ * Add an object to the constants of the code, unless it's already one of them.
+ * @param compilation the code being compiled
+ * @param constant the object
+ * @returns the index of the constant
+ */
+static int addConstant(Compilation& compilation, Object* constant)
+{
+  std::vector<Object*>& constants{compilation.code.constants};
+  auto found{std::find(constants.begin(), constants.end(), constant)};
+  if (found == constants.end()) {
+    constants.push_back(constant);
+    return static_cast<int>(constants.size()) - 1;
+  }
+  return static_cast<int>(found - constants.begin());
+}
+
+/**
+ * Check whether an operator refers to one of the builtin syntax elements. Syntax is recognised
+ * when the expression is compiled, forms of resolved lambda bodies that weren't analyzed keep
+ * their syntax operators as symbols.
+ * @param compilation the code being compiled
+ * @param operation the first element of an expression
+ * @returns the syntax object, NULL if the operator isn't syntax
+ */
+static Object* getSyntax(Compilation& compilation, Object* operation)
+{
+  if (!hasTag(operation, TAG_SYMBOL)) {
+    return NULL;
+  }
+  Object* value{getVariable(compilation.env, operation)};
+  return (value != NULL && hasTag(value, TAG_SYNTAX)) ? value : NULL;
+}
+
+static void compile(Compilation& compilation, Object* expression, bool isTail);
+
+/**
+ * Leave an expression to the trampoline. Used for help and for syntax of an unusual shape, so
+ * malformed expressions fail with the same error as without the virtual machine.
+ * @param compilation the code being compiled
+ * @param expression the expression
+ */
+static void compileFallback(Compilation& compilation, Object* expression)
+{
+  emit(compilation, OP_EVALUATE, addConstant(compilation, expression));
+}
+
+/**
+ * Compile a list of expressions whose last value is the result, as begin does.
+ * @param compilation the code being compiled
+ * @param expressions a proper list of at least one expression
+ * @param isTail whether the last expression is in tail position
+ */
+static void compileSequence(Compilation& compilation, Object* expressions, bool isTail)
+{
+  for (; getCdr(expressions) != SCM_NIL; expressions = getCdr(expressions)) {
+    compile(compilation, getCar(expressions), false);
+    emit(compilation, OP_POP);
+  }
+  compile(compilation, getCar(expressions), isTail);
+}
+
+/**
+ * Compile the body of a lambda into a new piece of code. Like evaluateUserDefinedFunction, a
+ * body starting with a list or a special form is a sequence of expressions, any other body a
+ * single expression.
+ * @param compilation the lambda being compiled, its argument list and body are set already
+ * @returns the bytecode object
+ */
+static Object* compileBody(Compilation& compilation)
+{
+  Object* bodyList{compilation.code.bodyList};
+  if (hasTag(bodyList, TAG_CONS) &&
+      (hasTag(getCar(bodyList), TAG_CONS) || hasTag(getCar(bodyList), TAG_SPECIAL_FORM)) &&
+      listLength(bodyList) > 0) {
+    compileSequence(compilation, bodyList, true);
+  }
+  else {
+    compile(compilation, bodyList, true);
+  }
+  emit(compilation, OP_RETURN);
+  DLOG_IF_F(INFO,
+            LOG_EVALUATION,
+            "compiled lambda %s to %d instructions",
+            toString(compilation.code.argList).c_str(),
+            static_cast<int>(compilation.code.instructions.size()));
+  return newBytecode(std::move(compilation.code));
+}
+
+/**
+ * Compile a lambda nested in the code being compiled, the same way lambdaSyntax creates it.
+ * @param compilation the enclosing code
+ * @param argList the argument list of the lambda, a proper list of symbols
+ * @param bodyList the body of the lambda
+ * @returns the bytecode object, OP_CLOSURE turns it into a function
+ */
+static Object* compileLambda(Compilation& compilation, Object* argList, Object* bodyList)
+{
+  Environment& globalEnv{getGlobalEnvironment(compilation.env)};
+  Object* slotNames{collectSlotNames(argList, bodyList, globalEnv)};
+  if (compilation.resolvesLambdas) {
+    bodyList = resolveLambdaBody(slotNames, bodyList, globalEnv);
+  }
+  Compilation lambda{{{}, {}, argList, bodyList, slotNames, listLength(argList)},
+                     compilation.env,
+                     false};
+  return compileBody(lambda);
+}
+
+/**
+ * Compile a conditional, only the branch in tail position of the whole code ends with a jump.
+ * @param compilation the code being compiled
+ * @param condition the condition
+ * @param consequent the expression used if the condition is true
+ * @param alternative the expression used otherwise
+ * @param isTail whether the if is in tail position
+ */
+static void compileIf(Compilation& compilation,
+                      Object* condition,
+                      Object* consequent,
+                      Object* alternative,
+                      bool isTail)
+{
+  compile(compilation, condition, false);
+  int jumpToFalse{emit(compilation, OP_JUMP_IF_FALSE)};
+  compile(compilation, consequent, isTail);
+  // a branch in tail position returns right away instead of jumping to the return
+  int jumpToEnd{emit(compilation, isTail ? OP_RETURN : OP_JUMP)};
+  std::vector<Instruction>& instructions{compilation.code.instructions};
+  instructions[static_cast<std::size_t>(jumpToFalse)].operand =
+      static_cast<int>(instructions.size());
+  compile(compilation, alternative, isTail);
+  if (!isTail) {
+    instructions[static_cast<std::size_t>(jumpToEnd)].operand =
+        static_cast<int>(instructions.size());
+  }
+}
+
+/**
+ * Compile a definition of a variable or the shorthand definition of a function.
+ * @param compilation the code being compiled
+ * @param arguments the arguments of define
+ * @returns false if the definition has to be left to the trampoline
+ */
+static bool compileDefine(Compilation& compilation, Object* arguments)
+{
+  if (!hasTag(arguments, TAG_CONS)) {
+    return false;
+  }
+  Object* target{getCar(arguments)};
+  // shorthand lambda definition: (define (name args...) body...)
+  if (hasTag(target, TAG_CONS)) {
+    if (!isArgumentList(getCdr(target))) {
+      return false;
+    }
+    Object* lambda{compileLambda(compilation, getCdr(target), getCdr(arguments))};
+    emit(compilation, OP_CLOSURE, addConstant(compilation, lambda));
+    emit(compilation, OP_DEFINE, addConstant(compilation, getCar(target)));
+    return true;
+  }
+  if (!(hasTag(target, TAG_SYMBOL) || hasTag(target, TAG_LOCAL_REF)) ||
+      listLength(arguments) != 2) {
+    return false;
+  }
+  compile(compilation, getCar(getCdr(arguments)), false);
+  emit(compilation, OP_DEFINE, addConstant(compilation, target));
+  return true;
+}
+
+/**
+ * Compile a call: the operator and the arguments are evaluated from left to right.
+ * @param compilation the code being compiled
+ * @param expression the call
+ * @param isTail whether the call is in tail position and may replace the current one
+ */
+static void compileCall(Compilation& compilation, Object* expression, bool isTail)
+{
+  int nArgs{listLength(getCdr(expression))};
+  if (nArgs < 0) {
+    compileFallback(compilation, expression);
+    return;
+  }
+  for (Object* element{expression}; element != SCM_NIL; element = getCdr(element)) {
+    compile(compilation, getCar(element), false);
+  }
+  emit(compilation, isTail ? OP_TAIL_CALL : OP_CALL, nArgs);
+}
+
+/**
+ * Compile a list expression, either a syntax form or a call.
+ * @param compilation the code being compiled
+ * @param expression the expression
+ * @param isTail whether the expression is in tail position
+ */
+static void compileForm(Compilation& compilation, Object* expression, bool isTail)
+{
+  Object* arguments{getCdr(expression)};
+  Object* syntax{getSyntax(compilation, getCar(expression))};
+  if (syntax == NULL) {
+    compileCall(compilation, expression, isTail);
+    return;
+  }
+  int nArguments{listLength(arguments)};
+  switch (getBuiltinFuncTag(syntax)) {
+    case SYNTAX_QUOTE: {
+      // like quoteSyntax, (quote) without an argument cons evaluates to what follows quote
+      Object* quoted{hasTag(arguments, TAG_CONS) ? getCar(arguments) : arguments};
+      emit(compilation, OP_CONSTANT, addConstant(compilation, quoted));
+      return;
+    }
+    case SYNTAX_IF:
+      if (nArguments == 3) {
+        Object* branches{getCdr(arguments)};
+        compileIf(compilation,
+                  getCar(arguments),
+                  getCar(branches),
+                  getCar(getCdr(branches)),
+                  isTail);
+        return;
+      }
+      break;
+    case SYNTAX_BEGIN:
+      if (nArguments > 0) {
+        compileSequence(compilation, arguments, isTail);
+        return;
+      }
+      break;
+    case SYNTAX_DEFINE:
+      if (compileDefine(compilation, arguments)) {
+        return;
+      }
+      break;
+    case SYNTAX_SET:
+      if (nArguments == 2) {
+        compile(compilation, getCar(getCdr(arguments)), false);
+        emit(compilation, OP_SET, addConstant(compilation, getCar(arguments)));
+        return;
+      }
+      break;
+    case SYNTAX_LAMBDA:
+      if (nArguments > 0 && isArgumentList(getCar(arguments))) {
+        Object* lambda{compileLambda(compilation, getCar(arguments), getCdr(arguments))};
+        emit(compilation, OP_CLOSURE, addConstant(compilation, lambda));
+        return;
+      }
+      break;
+    default:
+      break;
+  }
+  compileFallback(compilation, expression);
+}
+
+/**
+ * Compile a syntax form that was analyzed when the lambda containing it was resolved. Its shape
+ * was checked then, so there's no need for a fallback.
+ * @param compilation the code being compiled
+ * @param form the special form object
+ * @param isTail whether the form is in tail position
+ */
+static void compileSpecialForm(Compilation& compilation, Object* form, bool isTail)
+{
+  const SpecialFormValue& value{getSpecialForm(form)};
+  switch (value.syntax) {
+    case SYNTAX_QUOTE:
+      emit(compilation, OP_CONSTANT, addConstant(compilation, value.first));
+      break;
+    case SYNTAX_IF:
+      compileIf(compilation, value.first, value.second, value.third, isTail);
+      break;
+    case SYNTAX_BEGIN:
+      compileSequence(compilation, value.first, isTail);
+      break;
+    case SYNTAX_DEFINE:
+      compile(compilation, value.second, false);
+      emit(compilation, OP_DEFINE, addConstant(compilation, value.first));
+      break;
+    case SYNTAX_SET:
+      compile(compilation, value.second, false);
+      emit(compilation, OP_SET, addConstant(compilation, value.first));
+      break;
+    case SYNTAX_LAMBDA: {
+      Compilation lambda{
+          {{}, {}, value.first, value.second, value.third, listLength(value.first)},
+          compilation.env,
+          false};
+      emit(compilation, OP_CLOSURE, addConstant(compilation, compileBody(lambda)));
+      break;
+    }
+    default:
+      compileFallback(compilation, form);
+      break;
+  }
+}
+
+/**
+ * Compile an expression, its value is left on the value stack.
+ * @param compilation the code being compiled
+ * @param expression the expression
+ * @param isTail whether the value of the expression is the result of the whole code
+ */
+static void compile(Compilation& compilation, Object* expression, bool isTail)
+{
+  switch (getTag(expression)) {
+    case TAG_INT:
+    case TAG_FLOAT:
+    case TAG_STRING:
+    case TAG_NIL:
+    case TAG_FALSE:
+    case TAG_TRUE:
+    case TAG_FUNC_BUILTIN:
+    case TAG_EOF:
+      emit(compilation, OP_CONSTANT, addConstant(compilation, expression));
+      break;
+    case TAG_SYMBOL:
+      emit(compilation, OP_VARIABLE, addConstant(compilation, expression));
+      break;
+    case TAG_LOCAL_REF:
+      if (getLocalRef(expression).depth == 0) {
+        emit(compilation, OP_LOCAL, getLocalRef(expression).slot);
+      }
+      else {
+        emit(compilation, OP_OUTER_LOCAL, addConstant(compilation, expression));
+      }
+      break;
+    case TAG_GLOBAL_CELL:
+      emit(compilation, OP_GLOBAL, addConstant(compilation, expression));
+      break;
+    case TAG_CONS:
+      compileForm(compilation, expression, isTail);
+      break;
+    case TAG_SPECIAL_FORM:
+      compileSpecialForm(compilation, expression, isTail);
+      break;
+    // everything else can't be evaluated, the trampoline reports it
+    default:
+      compileFallback(compilation, expression);
+      break;
+  }
+}
+
+/**
+ * Compile a top level expression for the virtual machine.
+ * @param expression the parsed expression
+ * @param env the environment the expression will be evaluated in
+ * @returns the bytecode object, lambdas within the expression are compiled along with it
+ */
+Object* compileExpression(Object* expression, Environment& env)
+{
+  Compilation compilation{{{}, {}, NULL, NULL, NULL, 0}, env, isGlobalEnvironment(env)};
+  compile(compilation, expression, true);
+  emit(compilation, OP_RETURN);
+  DLOG_IF_F(INFO,
+            LOG_EVALUATION,
+            "compiled %s to %d instructions",
+            toString(expression).c_str(),
+            static_cast<int>(compilation.code.instructions.size()));
+  return newBytecode(std::move(compilation.code));
+}
+
+/**
+ * Compile the body of a user defined function that was created without the virtual machine.
+ * @param function the user defined function, its body is resolved already
+ * @returns the bytecode object
+ */
+Object* compileFunction(Object* function)
+{
+  Object* argList{getUserFunctionArgList(function)};
+  Compilation compilation{{{},
+                           {},
+                           argList,
+                           getUserFunctionBodyList(function),
+                           getUserFunctionSlotNames(function),
+                           listLength(argList)},
+                          *getUserFunctionParentEnv(function),
+                          false};
+  return compileBody(compilation);
+}
+
+}  // namespace scm
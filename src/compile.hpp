@@ -0,0 +1,10 @@
+#pragma once
+#include "environment.hpp"
+#include "scheme.hpp"
+
+namespace scm {
+
+Object* compileExpression(Object* expression, Environment& env);
+Object* compileFunction(Object* function);
+
+}  // namespace scm
@@ -1,8 +1,8 @@
 #include "environment.hpp"
+#include <algorithm>
 #include <exception>
 #include <iostream>
 #include <loguru.hpp>
-#include <map>
 #include <numeric>
 #include <vector>
 #include "memory.hpp"
@@ -10,104 +10,324 @@
 
 namespace scm {
 
+// the number of slots of a new table, a power of two so a mask can replace the modulo
+static constexpr std::size_t INITIAL_TABLE_SIZE{8};
+
 /**
- * Helper function to get the keys of any std::map as a vector
- * @tparam TYPE_KEY the type of the keys
- * @tparam TYPE_VALUE the type of the values
- * @param inputMap the map from which to get the keys
- * @returns a vector<TYPE_KEY> of all keys of inputMap
+ * Hash an interned symbol by its address. The lowest bits are always zero because of the
+ * alignment, multiplying by a large odd constant spreads the remaining bits (fibonacci hashing).
+ * @param key the symbol to hash
+ * @returns the hash value
  */
-template <typename TYPE_KEY, typename TYPE_VALUE>
-std::vector<TYPE_KEY> getKeys(std::map<TYPE_KEY, TYPE_VALUE> const& inputMap)
+static std::size_t hashSymbol(Object* key)
 {
-  std::vector<TYPE_KEY> keys;
-  for (auto const& element : inputMap) {
-    keys.push_back(element.first);
+  auto word{reinterpret_cast<std::uintptr_t>(key)};
+  return static_cast<std::size_t>((word >> 3) * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+/**
+ * Find the slot of a binding in a table.
+ * @param table the table in which to look
+ * @param key the interned symbol to look out for
+ * @returns a pointer to the value of the binding, NULL if there's no such binding
+ */
+Object** findBinding(BindingTable& table, Object* key)
+{
+  if (table.count == 0) {
+    return NULL;
+  }
+  std::size_t mask{table.slots.size() - 1};
+  for (std::size_t i{hashSymbol(key) & mask};; i = (i + 1) & mask) {
+    Binding& slot{table.slots[i]};
+    if (slot.key == key) {
+      return &slot.value;
+    }
+    if (slot.key == NULL) {
+      return NULL;
+    }
   }
-  return keys;
+}
+
+/**
+ * Double the capacity of a table and reinsert all bindings.
+ * @param table the table to grow
+ */
+static void growTable(BindingTable& table)
+{
+  std::vector<Binding> oldSlots{std::move(table.slots)};
+  table.slots.assign(oldSlots.empty() ? INITIAL_TABLE_SIZE : oldSlots.size() * 2, {NULL, NULL});
+  table.count = 0;
+  for (Binding& binding : oldSlots) {
+    if (binding.key != NULL) {
+      insertBinding(table, binding.key, binding.value);
+    }
+  }
+}
+
+/**
+ * Insert a binding into a table or overwrite the value of an existing one.
+ * @param table the table in which to insert
+ * @param key the interned symbol of the binding
+ * @param value the value of the binding
+ */
+void insertBinding(BindingTable& table, Object* key, Object* value)
+{
+  // the table grows once it's filled beyond 3/4 of its capacity
+  if ((table.count + 1) * 4 > table.slots.size() * 3) {
+    growTable(table);
+  }
+  std::size_t mask{table.slots.size() - 1};
+  for (std::size_t i{hashSymbol(key) & mask};; i = (i + 1) & mask) {
+    Binding& slot{table.slots[i]};
+    if (slot.key == key) {
+      slot.value = value;
+      return;
+    }
+    if (slot.key == NULL) {
+      slot = {key, value};
+      table.count++;
+      return;
+    }
+  }
+}
+
+/**
+ * Get the bindings of an environment sorted by their name, excluding parent environments.
+ * @param env the environment from which to get the bindings
+ * @returns a vector of bindings in alphabetical order
+ */
+std::vector<Binding> getBindings(Environment& env)
+{
+  std::vector<Binding> sorted;
+  bool isGlobal{isGlobalEnvironment(env)};
+  forEachBinding(env.bindings, [&sorted, isGlobal](Binding& binding) {
+    if (!isGlobal) {
+      sorted.push_back(binding);
+    }
+    // skip variables that are only referenced so far
+    else if (getGlobalCell(binding.value).value != NULL) {
+      sorted.push_back({binding.key, getGlobalCell(binding.value).value});
+    }
+  });
+  std::sort(sorted.begin(), sorted.end(), [](Binding& a, Binding& b) {
+    return getStringValue(a.key) < getStringValue(b.key);
+  });
+  return sorted;
 }
 
 /**
  * Copy constructor for the Environment class
  * @param env the environment to copy
  */
-Environment::Environment(const Environment& env)
+Environment::Environment(const Environment& env) : Collectable(TAG_ENVIRONMENT)
+{
+  *this = env;
+}
+
+/**
+ * Copy assignment for the Environment class. A copied top level environment gets cells of its
+ * own, defining a variable in the copy must not change the original. The collectable header of
+ * this environment is left untouched.
+ * @param env the environment to copy
+ * @returns a reference to this environment
+ */
+Environment& Environment::operator=(const Environment& env)
 {
   parentEnv = env.parentEnv;
   bindings = env.bindings;
+  slots = env.slots;
+  slotNames = env.slotNames;
+  if (parentEnv == NULL) {
+    forEachBinding(bindings, [this](Binding& binding) {
+      Object* cell{newGlobalCell(binding.key)};
+      getGlobalCell(cell).value = getGlobalCell(binding.value).value;
+      binding.value = cell;
+      writeBarrier(this, cell);
+    });
+  }
+  return *this;
 }
 
 /**
- * Get the value of a binding of a given string key in the specified Environment
- * @param env the environment in which to look
- * @param key the key to look out for
- * @returns The found variable
+ * Is the given environment a top level environment, i.e. not the frame of a function call?
+ * @param env the environment to check
+ * @returns true if the environment has no parent
  */
-Object* getVariable(Environment& env, std::string& key)
+bool isGlobalEnvironment(Environment& env)
+{
+  return env.parentEnv == NULL;
+}
+
+/**
+ * Get the top level environment an environment descends from.
+ * @param env the environment from which to start
+ * @returns the outermost ancestor of env
+ */
+Environment& getGlobalEnvironment(Environment& env)
 {
   Environment* currentEnvPtr = &env;
-  while (currentEnvPtr != NULL) {
-    std::map<std::string, Object*>::iterator found = currentEnvPtr->bindings.find(key);
-    if (found != currentEnvPtr->bindings.end()) {
-      return currentEnvPtr->bindings.at(key);
-    }
-    else {
-      currentEnvPtr = currentEnvPtr->parentEnv;
-    }
+  while (currentEnvPtr->parentEnv != NULL) {
+    currentEnvPtr = currentEnvPtr->parentEnv;
   }
-  return NULL;
+  return *currentEnvPtr;
+}
+
+/**
+ * Get the value of the frame slot a resolved local variable reference points to.
+ * @param env the frame in which the reference is evaluated
+ * @param ref the lexical address of the variable
+ * @returns the value of the slot, NULL while the variable is undefined
+ */
+Object* getSlot(Environment& env, const LocalRefValue& ref)
+{
+  Environment* frame{&env};
+  for (int i{0}; i < ref.depth; i++) {
+    frame = frame->parentEnv;
+  }
+  return frame->slots[static_cast<std::size_t>(ref.slot)];
+}
+
+/**
+ * Store a value in the frame slot a resolved local variable reference points to.
+ * @param env the frame in which the reference is evaluated
+ * @param ref the lexical address of the variable
+ * @param value the new value of the slot
+ */
+void setSlot(Environment& env, const LocalRefValue& ref, Object* value)
+{
+  Environment* frame{&env};
+  for (int i{0}; i < ref.depth; i++) {
+    frame = frame->parentEnv;
+  }
+  frame->slots[static_cast<std::size_t>(ref.slot)] = value;
+  writeBarrier(frame, value);
+}
+
+/**
+ * Get the value cell of a top level variable. Cells are created on the first definition or
+ * reference and never move, so resolved lambda bodies and call sites can hold on to them.
+ * @param env an environment descending from the top level environment of the variable
+ * @param symbol the interned name of the variable
+ * @returns the cell, its value is NULL while the variable is undefined
+ */
+Object* getGlobalCellOf(Environment& env, Object* symbol)
+{
+  Environment& globalEnv{getGlobalEnvironment(env)};
+  Object** found{findBinding(globalEnv.bindings, symbol)};
+  if (found != NULL) {
+    return *found;
+  }
+  Object* cell{newGlobalCell(symbol)};
+  insertBinding(globalEnv.bindings, symbol, cell);
+  writeBarrier(&globalEnv, cell);
+  return cell;
 }
 
 /**
  * Get the value of a binding of a given symbol Object key in the specified Environment
- * @overload
+ * @param env the environment in which to look
+ * @param key the interned symbol to look out for
+ * @returns The found variable, NULL if there's no such binding
  */
 Object* getVariable(Environment& env, Object* key)
 {
   if (!hasTag(key, TAG_SYMBOL)) {
     schemeThrow("values can only be bound to symbols");
   }
-  std::string keyStr{getStringValue(key)};
-  return getVariable(env, keyStr);
+  Environment* currentEnvPtr = &env;
+  while (currentEnvPtr != NULL) {
+    Object** found{findBinding(currentEnvPtr->bindings, key)};
+    if (found != NULL) {
+      return isGlobalEnvironment(*currentEnvPtr) ? getGlobalCell(*found).value : *found;
+    }
+    currentEnvPtr = currentEnvPtr->parentEnv;
+  }
+  return NULL;
 }
 
 /**
- * Define a new binding in the given environment.
- * @param env the environment in which to define
- * @param key the key of the binding
- * @param value the value of the binding
+ * Get the value of a binding of a given string key in the specified Environment
+ * @overload
  */
-void define(Environment& env, std::string& key, Object* value)
+Object* getVariable(Environment& env, std::string& key)
 {
-  DLOG_IF_F(INFO, LOG_ENVIRONMENT, "define %s := %s", key.c_str(), toString(value).c_str());
-  env.bindings[key] = value;
+  return getVariable(env, newSymbol(key));
 }
 
 /**
- * Define a new binding in the given environment, takes an Object* as key.
- * @overload
+ * Define a new binding in the given environment.
+ * @param env the environment in which to define
+ * @param key the interned symbol of the binding
+ * @param value the value of the binding
  */
 void define(Environment& env, Object* key, Object* value)
 {
+  // local variables of functions are stored in the slots of their frame
+  if (hasTag(key, TAG_LOCAL_REF)) {
+    DLOG_IF_F(INFO, LOG_ENVIRONMENT, "define local %s", toString(key).c_str());
+    setSlot(env, getLocalRef(key), value);
+    return;
+  }
   if (!hasTag(key, TAG_SYMBOL)) {
     schemeThrow("values can only be bound to symbols");
   }
-  std::string keyStr{getStringValue(key)};
-  define(env, keyStr, value);
+  DLOG_IF_F(INFO,
+            LOG_ENVIRONMENT,
+            "define %s := %s",
+            getStringValue(key).c_str(),
+            toString(value).c_str());
+  if (isGlobalEnvironment(env)) {
+    Object* cell{getGlobalCellOf(env, key)};
+    getGlobalCell(cell).value = value;
+    writeBarrier(cell, value);
+    return;
+  }
+  insertBinding(env.bindings, key, value);
+  writeBarrier(&env, key);
+  writeBarrier(&env, value);
+}
+
+/**
+ * Define a new binding in the given environment, takes a string as key.
+ * @overload
+ */
+void define(Environment& env, std::string& key, Object* value)
+{
+  define(env, newSymbol(key), value);
 }
 
 /**
  * Set a new binding in the given environment and all ancestor environments.
+ * Frames that hold a local variable of the same name get their slot updated instead.
  * @param env the environment in which to define
- * @param key the key of the binding
+ * @param key the key of the binding, a symbol, a resolved local variable or a global cell
  * @param value the value of the binding
  */
 void set(Environment& env, Object* key, Object* value)
 {
+  Object* symbol{key};
+  if (hasTag(key, TAG_LOCAL_REF)) {
+    symbol = getLocalRef(key).symbol;
+  }
+  else if (hasTag(key, TAG_GLOBAL_CELL)) {
+    symbol = getGlobalCell(key).symbol;
+  }
   Environment* currentEnvPtr = &env;
   // define variable in every env until no parent env can be found
   while (currentEnvPtr != NULL) {
-    define(*currentEnvPtr, key, value);
+    int slot{0};
+    Object* name{currentEnvPtr->slotNames};
+    while (name != NULL && name != SCM_NIL && getCar(name) != symbol) {
+      name = getCdr(name);
+      slot++;
+    }
+    if (name != NULL && name != SCM_NIL) {
+      currentEnvPtr->slots[static_cast<std::size_t>(slot)] = value;
+      writeBarrier(currentEnvPtr, value);
+    }
+    else {
+      define(*currentEnvPtr, symbol, value);
+    }
     currentEnvPtr = (*currentEnvPtr).parentEnv;
   };
 }
@@ -121,23 +341,23 @@ void set(Environment& env, Object* key, Object* value)
  */
 void printCategory(Environment& env, std::function<bool(Object*)> checkFunction, int maxNameLength)
 {
-  for (auto& binding : env.bindings) {
-    if (checkFunction(binding.second)) {
-      std::string name = binding.first;
+  for (auto& binding : getBindings(env)) {
+    if (checkFunction(binding.value)) {
+      const std::string& name{getStringValue(binding.key)};
       std::cout << name;
       for (int i{0}; i < maxNameLength - name.size(); i++) {
         std::cout << ' ';
       }
       std::cout << " :=  ";
-      if (hasTag(binding.second, TAG_FUNC_USER)) {
-        std::cout << toString(getUserFunctionArgList(binding.second));
+      if (hasTag(binding.value, TAG_FUNC_USER)) {
+        std::cout << toString(getUserFunctionArgList(binding.value));
       }
-      else if (isOneOf(binding.second, {TAG_FUNC_BUILTIN, TAG_SYNTAX})) {
-        std::cout << getBuiltinFuncHelpText(binding.second)
-                         .substr(0, getBuiltinFuncHelpText(binding.second).find('\n'));
+      else if (isOneOf(binding.value, {TAG_FUNC_BUILTIN, TAG_SYNTAX})) {
+        std::cout << getBuiltinFuncHelpText(binding.value)
+                         .substr(0, getBuiltinFuncHelpText(binding.value).find('\n'));
       }
       else {
-        std::cout << toString(binding.second);
+        std::cout << toString(binding.value);
       }
       std::cout << "\n";
     }
@@ -151,11 +371,11 @@ void printCategory(Environment& env, std::function<bool(Object*)> checkFunction,
 void printEnv(Environment& env)
 {
   // get longest variable name for spacing purposes
-  std::vector<std::string> keys{getKeys(env.bindings)};
-  int longestVariableNameLength =
-      std::accumulate(keys.begin(), keys.end(), 0, [](int longestLength, std::string& binding) {
-        return (binding.size() > longestLength) ? binding.size() : longestLength;
-      });
+  int longestVariableNameLength{0};
+  forEachBinding(env.bindings, [&longestVariableNameLength](Binding& binding) {
+    int length{static_cast<int>(getStringValue(binding.key).size())};
+    longestVariableNameLength = std::max(length, longestVariableNameLength);
+  });
 
   std::cout << "======== SYNTAX ========\n";
   std::function<bool(Object*)> lambda = [](Object* obj) { return hasTag(obj, TAG_SYNTAX); };
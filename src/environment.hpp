@@ -1,35 +1,96 @@
 #pragma once
-#include <map>
+#include <cstddef>
+#include <vector>
 // #include "garbage_collection.hpp"
 #include "scheme.hpp"
 
 namespace scm {
 
+/**
+ * A single variable binding of an environment
+ */
+struct Binding {
+  // the interned symbol, NULL marks an empty slot
+  Object* key;
+  Object* value;
+};
+
+/**
+ * An open addressing hash table mapping interned symbols to their values.
+ * Collisions are resolved by linear probing, so a lookup touches consecutive memory and most
+ * frames fit in one or two cache lines. Slots are only allocated on the first definition.
+ */
+struct BindingTable {
+  // the number of slots is always zero or a power of two
+  std::vector<Binding> slots;
+  std::size_t count{0};
+};
+
+Object** findBinding(BindingTable& table, Object* key);
+void insertBinding(BindingTable& table, Object* key, Object* value);
+
+/**
+ * Call a function on every binding of a table.
+ * @tparam FUNC a callable taking a Binding&
+ * @param table the table to iterate over
+ * @param callback the function to call
+ */
+template <typename FUNC>
+void forEachBinding(BindingTable& table, FUNC callback)
+{
+  for (Binding& binding : table.slots) {
+    if (binding.key != NULL) {
+      callback(binding);
+    }
+  }
+}
+
 /**
  * Used as a container for variable definitions. All functions, syntax and user defined
  * objects are stored in an environment. They are organised in an hierarchical manner with each
  * Environment object pointing to its parent Environment. Therefore, children have access to the
  * variables defined in their parent Environment but not vice versa.
+ * Environments live on the garbage collected heap, a frame is freed once neither a closure nor
+ * the trampoline refers to it anymore.
  */
-class Environment {
+class Environment : public Collectable {
  private:
-  std::map<std::string, Object*> bindings;
+  // keyed by interned symbol, so lookups only compare pointers
+  // in a top level environment the values are global cells rather than the variables' values
+  BindingTable bindings;
   Environment* parentEnv;
+  // the local variables of a function call, addressed by index, see resolve.cpp
+  std::vector<Object*> slots;
+  // the names of the slots as a list of symbols
+  Object* slotNames;
 
  public:
-  Environment(Environment* parent = NULL) : parentEnv(parent){};
+  Environment(Environment* parent = NULL)
+      : Collectable(TAG_ENVIRONMENT), parentEnv(parent), slots(), slotNames(NULL){};
+  Environment(Environment* parent, Object* slotNames, int frameSize)
+      : Collectable(TAG_ENVIRONMENT),
+        parentEnv(parent),
+        slots(static_cast<std::size_t>(frameSize), NULL),
+        slotNames(slotNames){};
   Environment(const Environment& obj);
+  Environment& operator=(const Environment& obj);
   ~Environment() = default;
   friend void set(Environment& env, Object* key, Object* value);
-  friend void define(Environment& env, std::string& key, Object* value);
+  friend void define(Environment& env, Object* key, Object* value);
   friend void printCategory(Environment& env,
                             std::function<bool(Object*)> checkFunction,
                             int maxNameLength);
   friend void printEnv(Environment& env);
   friend Object* getVariable(Environment& env, Object* key);
-  friend Object* getVariable(Environment& env, std::string& key);
+  friend std::vector<Binding> getBindings(Environment& env);
+  friend Environment& getGlobalEnvironment(Environment& env);
+  friend bool isGlobalEnvironment(Environment& env);
+  friend Object* getSlot(Environment& env, const LocalRefValue& ref);
+  friend void setSlot(Environment& env, const LocalRefValue& ref, Object* value);
+  friend Object* getGlobalCellOf(Environment& env, Object* symbol);
   // garbage collection
   friend void mark(Environment& env);
+  friend void forwardReferences(Environment& env);
 };
 
 void define(Environment& env, Object* key, Object* value);
@@ -38,5 +99,11 @@ void set(Environment& env, Object* key, Object* value);
 void printEnv(Environment& env);
 Object* getVariable(Environment& env, Object* key);
 Object* getVariable(Environment& env, std::string& key);
+std::vector<Binding> getBindings(Environment& env);
+Environment& getGlobalEnvironment(Environment& env);
+bool isGlobalEnvironment(Environment& env);
+Object* getSlot(Environment& env, const LocalRefValue& ref);
+void setSlot(Environment& env, const LocalRefValue& ref, Object* value);
+Object* getGlobalCellOf(Environment& env, Object* symbol);
 
 }  // namespace scm
@@ -8,6 +8,7 @@
 #include "operations.hpp"
 #include "scheme.hpp"
 #include "trampoline.hpp"
+#include "vm.hpp"
 
 namespace scm {
 namespace trampoline {
@@ -24,16 +25,30 @@ namespace trampoline {
 
 /**
  * This function is used as a wrapper for our trampoline in order to
- * obfuscate it from the main REPL.
+ * obfuscate it from the main REPL. Runs the virtual machine instead if it was enabled by `--vm`.
  * @param env The top level environment used for the evaluation
  * @param expression The expression to be evaluated
  * @returns the result of the expression
  */
 Object* evaluateExpression(Environment& env, Object* expression)
 {
-  DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluateExpression");
+  if (vm::isEnabled()) {
+    return vm::evaluateExpression(env, expression);
+  }
+  return interpretExpression(env, expression);
+}
+
+/**
+ * Evaluate an expression by walking it with the trampoline, no matter which engine is enabled.
+ * @param env The environment used for the evaluation
+ * @param expression The expression to be evaluated
+ * @returns the result of the expression
+ */
+Object* interpretExpression(Environment& env, Object* expression)
+{
+  DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: interpretExpression");
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "expression: %s", toString(expression).c_str());
-  pushArgs({&env, expression});
+  pushFrame({&env, expression});
   return trampoline(cont(evaluate));
 }
 
@@ -43,39 +58,29 @@ Object* evaluateExpression(Environment& env, Object* expression)
 static Continuation* evaluateArguments_Part1();
 /**
  * Evaluates the argument cons object that used to be passed to functions and
- * stores them in the argument stack.
- * Expects parameters as pop form the argument stack
+ * stores them in the value stack.
+ * Expects its frame on the frame stack: {env, operation, argumentCons}
  * @param env Environment in which to evaluate the arguments
  * @param operation the currently evaluated operation
  * @param argumentCons the lis of arguments as a cons Object
- * @returns the next step in our trampoline
+ * @returns the next step in our trampoline, which finds {env, operation, nArgs} on the stack
  */
 static Continuation* evaluateArguments()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluateArguments");
   // get arguments from stack
-  Environment* env{popArg<Environment*>()};
-  Object* operation{popArg<Object*>()};
-  Object* argumentCons{popArg<Object*>()};
-
-  // keep track of how many arguments were evaluated
-  int nArgs{0};
+  Frame frame{popFrame()};
+  Object* argumentCons{frame.rest};
 
   if (argumentCons != SCM_NIL) {
-    // push arguments for evaluateArgunents_Part1
-    pushArgs({
-        env,
-        operation,
-        argumentCons,  // function arguments
-        ++nArgs        // local variables
-    });
+    // frame for evaluateArgunents_Part1, counting the arguments evaluated so far
+    pushFrame({frame.env, frame.expression, argumentCons, 1});
     // push and call evaluate on current argument
     Object* currentArgument{getCar(argumentCons)};
-    return tCall(cont(evaluate), cont(evaluateArguments_Part1), {env, currentArgument});
+    return tCall(cont(evaluate), cont(evaluateArguments_Part1), {frame.env, currentArgument});
   }
   else {
-    // todo: do we need to push stacksizeatstart here?
-    pushArgs({env, operation, nArgs});
+    pushFrame({frame.env, frame.expression, NULL, 0});
     return popFunc();
   }
 };
@@ -83,184 +88,136 @@ static Continuation* evaluateArguments()
 /**
  * The continuation of evaluateArguments.
  * Is called again and again until all arguments have ben evaluated and pushed to the stack.
- * Expects parameters as pop form the argument stack
+ * Expects its frame on the frame stack: {env, operation, argumentCons, nArgs}
  * @param env Environment in which to evaluate the arguments
  * @param operation the currently evaluated operation
  * @param argumentCons the lis of arguments as a cons Object
+ * @param nArgs the number of arguments evaluated so far
  * @returns the next step in our trampoline
  */
 static Continuation* evaluateArguments_Part1()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluateArguments Part1");
   // get variables from stack
-  Environment* env = popArg<Environment*>();
-  Object* operation = popArg<Object*>();
-  Object* argumentCons = popArg<Object*>();
-  int nArgs = popArg<int>();
+  Frame frame{popFrame()};
 
   // get evaluated object and store on stack for later functions
-  pushArg(lastReturnValue);
+  pushValue(lastReturnValue);
 
   // "loop" with next argument or return
-  argumentCons = getCdr(argumentCons);
+  Object* argumentCons{getCdr(frame.rest)};
   if (argumentCons != SCM_NIL) {
     Object* nextArg{getCar(argumentCons)};
-    // arguments for evaluateArguments_Part1
-    pushArgs({env, operation, argumentCons, ++nArgs});
+    // frame for evaluateArguments_Part1
+    pushFrame({frame.env, frame.expression, argumentCons, frame.count + 1});
     // call evaluation for next argument
-    return tCall(cont(evaluate), cont(evaluateArguments_Part1), {env, nextArg});
+    return tCall(cont(evaluate), cont(evaluateArguments_Part1), {frame.env, nextArg});
   }
   else {
-    pushArgs({env, operation, nArgs});
+    pushFrame({frame.env, frame.expression, NULL, frame.count});
     return popFunc();
   }
 };
 
 /**
  * Evaluates a builtin function and writes the result to `lastReturnValue`.
- * Expects parameters as pop form the argument stack.
+ * Expects its frame on the frame stack: {env, function, nArgs}. The frame is left there for the
+ * builtin function, which takes its arguments from the value stack.
  * @param env Environment in which to evaluate the arguments
  * @param function the currently evaluated function
- * @param nArgs the number of Arguments to be popped from the argument stack
+ * @param nArgs the number of Arguments to be popped from the value stack
  * @returns the next function in the function stack
  */
 static Continuation* evaluateBuiltinFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluateBuiltinFunction");
   // get arguments from stack
-  Environment* env{popArg<Environment*>()};
-  Object* function{popArg<Object*>()};
-  int nArgs{popArg<int>()};
+  const Frame& frame{frameStack.back()};
+  Object* function{frame.expression};
+  int nArgs{frame.count};
 
-  DLOG_IF_F(INFO,
-            LOG_TRAMPOLINE_TRACE,
-            "evaluate builtin function %s",
-            getBuiltinFuncName(function).c_str());
+  const BuiltinDescriptor& descriptor{getBuiltinDescriptor(function)};
+
+  DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "evaluate builtin function %s", descriptor.name);
   // catch wrong number of arguments
-  if (nArgs != getBuiltinFuncNArgs(function) && getBuiltinFuncNArgs(function) != -1) {
+  if (nArgs != descriptor.nArgs && descriptor.nArgs != -1) {
     schemeThrow("function " + getBuiltinFuncName(function) + " expects " +
-                std::to_string(getBuiltinFuncNArgs(function)) + " arguments, got " +
-                std::to_string(nArgs) + '\n');
+                std::to_string(descriptor.nArgs) + " arguments, got " + std::to_string(nArgs) +
+                '\n');
   }
-
-  // push arguments required for evaluation of builtin functions
-  pushArg(nArgs);
-  switch (getBuiltinFuncTag(function)) {
-    case FUNC_ADD:
-      return addFunction();
-      break;
-    case FUNC_SUB:
-      return subFunction();
-      break;
-    case FUNC_MULT:
-      return multFunction();
-      break;
-    case FUNC_DIV:
-      return divFunction();
-      break;
-    case FUNC_CONS:
-      return consFunction();
-      break;
-    case FUNC_CAR:
-      return carFunction();
-      break;
-    case FUNC_CDR:
-      return cdrFunction();
-      break;
-    case FUNC_EQ:
-      return eqFunction();
-      break;
-    case FUNC_EQUAL_STRING:
-      return equalStringFunction();
-      break;
-    case FUNC_EQUAL_NUMBER:
-      return equalNumberFunction();
-      break;
-    case FUNC_GT:
-      return greaterThanFunction();
-      break;
-    case FUNC_LT:
-      return lesserThanFunction();
-      break;
-    case FUNC_DISPLAY:
-      return displayFunction();
-      break;
-    case FUNC_LIST:
-      return listFunction();
-      break;
-    case FUNC_FUNCTION_BODY:
-      return functionBodyFunction();
-      break;
-    case FUNC_FUNCTION_ARGLIST:
-      return functionArglistFunction();
-      break;
-    case FUNC_IS_STRING:
-      return isStringFunction();
-      break;
-    case FUNC_IS_NUMBER:
-      return isNumberFunction();
-      break;
-    case FUNC_IS_CONS:
-      return isConsFunction();
-      break;
-    case FUNC_IS_FUNC:
-      return isBuiltinFunctionFunction();
-      break;
-    case FUNC_IS_USERFUNC:
-      return isUserFunctionFunction();
-      break;
-    case FUNC_IS_BOOL:
-      return isBoolFunction();
-      break;
-    default:
-      schemeThrow("undefined builtin function: " + toString(function));
-      break;
+  // two integers or two floats skip the general, variadic implementation
+  if (nArgs == 2 && descriptor.binaryFastPath) {
+    Object* result{descriptor.binaryFastPath(valueStack.values[valueStack.size - 2],
+                                             valueStack.values[valueStack.size - 1])};
+    if (result) {
+      popFrame();
+      popValues(2);
+      t_RETURN(result);
+    }
   }
+  return descriptor.entry();
+}
+
+/**
+ * Call a builtin function whose arguments were pushed onto the value stack by the caller, the
+ * way the virtual machine calls them.
+ * @param function the builtin function
+ * @param nArgs the number of arguments on the value stack
+ * @returns the result of the function
+ */
+Object* applyBuiltinFunction(Object* function, int nArgs)
+{
+  pushFrame({NULL, function, NULL, nArgs});
+  return trampoline(cont(evaluateBuiltinFunction));
 }
 
 /**
  * Evaluate a user defined function object and writes the result to `lastReturnValue`.
- * Expects parameters as pop form the argument stack.
+ * Expects its frame on the frame stack: {env, function, nArgs}
  * @param env Environment in which to evaluate the arguments
  * @param function the currently evaluated function
- * @param nArgs the number of Arguments to be popped from the argument stack
+ * @param nArgs the number of Arguments to be popped from the value stack
  * @returns the next function in the function stack
  */
 static Continuation* evaluateUserDefinedFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluateUserDefinedFunction");
   // pop arguments from stack
-  Environment* env{popArg<Environment*>()};
-  Object* function{popArg<Object*>()};
-  int nArgs{popArg<int>()};
+  Frame frame{popFrame()};
+  Object* function{frame.expression};
+  int nArgs{frame.count};
 
   // get arguments and list of expressions
   Object* functionArguments{getUserFunctionArgList(function)};
   Object* functionBody{getUserFunctionBodyList(function)};
-  Environment* funcEnv{new Environment(getUserFunctionParentEnv(function))};
+  // the frame has one slot per local variable, the arguments come first
+  Environment* funcEnv{newEnvironment(getUserFunctionParentEnv(function),
+                                      getUserFunctionSlotNames(function),
+                                      getUserFunctionFrameSize(function))};
 
   if (nArgs == 0 && functionArguments != SCM_NIL) {
     schemeThrow("to few arguments passed to function, type `(help fname)` for more information");
   }
 
   if (nArgs > 0) {
-    ObjectVec evaluatedArguments{popArgs<Object*>(nArgs)};
+    Object** evaluatedArguments{popValues(nArgs)};
 
-    // define all function arguments in the function environment
+    // store all function arguments in the slots of the frame
+    int slot{0};
     while (functionArguments != SCM_NIL) {
-      if (nArgs == 0) {
+      if (slot == nArgs) {
         schemeThrow(
             "to few arguments passed to function, type `(help fname)` for more information");
       }
-      Object* argName{getCar(functionArguments)};
-      Object* argValue{evaluatedArguments[--nArgs]};
-      define(*funcEnv, argName, argValue);
+      Object* argValue{evaluatedArguments[slot]};
+      setSlot(*funcEnv, {getCar(functionArguments), 0, slot++}, argValue);
       functionArguments = getCdr(functionArguments);
     }
   }
 
-  // body may be a single expression or multiple!
-  if (hasTag(getCar(functionBody), TAG_CONS)) {
+  // body may be a single expression or multiple! analyzed bodies hold special forms, too
+  Object* firstExpression{getCar(functionBody)};
+  if (hasTag(firstExpression, TAG_CONS) || hasTag(firstExpression, TAG_SPECIAL_FORM)) {
     return tCall(cont(beginSyntax), {funcEnv, functionBody});
   }
   else {
@@ -270,7 +227,7 @@ static Continuation* evaluateUserDefinedFunction()
 
 /**
  * Evaluate a syntax object and writes the result to `lastReturnValue`.
- * Expects parameters as pop form the argument stack.
+ * Expects its frame on the frame stack: {env, syntax, arguments}
  * @param env Environment in which to evaluate the arguments
  * @param syntax the currently evaluated syntax
  * @param arguments the arguments passed to the syntax
@@ -280,48 +237,23 @@ static Continuation* evaluateSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluateSyntax");
   // pop required arguments
-  Environment* env{popArg<Environment*>()};
-  Object* syntax{popArg<Object*>()};
-  Object* arguments{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Object* syntax{frame.expression};
 
   // check if syntax really is a syntax
   if (!hasTag(syntax, TAG_SYNTAX)) {
     schemeThrow(toString(syntax) + " isn't a valid syntax");
   }
 
-  // push arguments required for syntax evaluation
-  pushArgs({env, arguments});
-  switch (getBuiltinFuncTag(syntax)) {
-    case SYNTAX_QUOTE:
-      return quoteSyntax();
-      break;
-    case SYNTAX_LAMBDA:
-      return lambdaSyntax();
-      break;
-    case SYNTAX_DEFINE:
-      return defineSyntax();
-      break;
-    case SYNTAX_IF:
-      return ifSyntax();
-      break;
-    case SYNTAX_SET:
-      return setSyntax();
-      break;
-    case SYNTAX_BEGIN:
-      return beginSyntax();
-      break;
-    case SYNTAX_HELP:
-      return helpSyntax();
-    default:
-      schemeThrow("undefined syntax: " + toString(syntax));
-      break;
-  }
+  // push the frame required for syntax evaluation
+  pushFrame({frame.env, frame.rest});
+  return getBuiltinDescriptor(syntax).entry();
 }
 
 static Continuation* evaluate_Part1();
 /**
  * Evaluates the next object on the stack
- * Expects parameters as pop from the argument stack.
+ * Expects its frame on the frame stack: {env, obj}
  * @param env the environment in which tho evaluate the object
  * @param obj the object to be evaluated
  * @returns the next function on the function stack or another continuation function
@@ -329,12 +261,13 @@ static Continuation* evaluate_Part1();
 Continuation* evaluate()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluate");
-  // get current environment and expression from their stacks
-  Environment* env{popArg<Environment*>()};
-  Object* obj{popArg<Object*>()};
+  // get current environment and expression from the stack
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* obj{frame.expression};
 
   scm::Object* evaluatedObj;
-  switch (obj->tag) {
+  switch (getTag(obj)) {
     case scm::TAG_INT:
     case scm::TAG_FLOAT:
     case scm::TAG_STRING:
@@ -348,7 +281,7 @@ Continuation* evaluate()
     case scm::TAG_SYMBOL: {
       evaluatedObj = getVariable(*env, obj);
       if (!evaluatedObj) {
-        schemeThrow("undefined variable: " + std::get<std::string>(obj->value));
+        schemeThrow("undefined variable: " + getStringValue(obj));
       }
       DLOG_IF_F(INFO,
                 LOG_EVALUATION,
@@ -357,15 +290,33 @@ Continuation* evaluate()
                 toString(evaluatedObj).c_str());
       t_RETURN(evaluatedObj);
     }
+    case scm::TAG_LOCAL_REF: {
+      evaluatedObj = getSlot(*env, getLocalRef(obj));
+      if (!evaluatedObj) {
+        schemeThrow("undefined variable: " + toString(obj));
+      }
+      t_RETURN(evaluatedObj);
+    }
+    case scm::TAG_GLOBAL_CELL: {
+      evaluatedObj = getGlobalCell(obj).value;
+      if (!evaluatedObj) {
+        schemeThrow("undefined variable: " + toString(obj));
+      }
+      t_RETURN(evaluatedObj);
+    }
     case scm::TAG_CONS: {
       Object* operation{getCar(obj)};
       // reason for split: Object* evaluatedOperation = evaluate(env, operation);
-      // push arguments for evaluate_Part1
-      pushArgs({env, obj});
+      // push the frame for evaluate_Part1
+      pushFrame({env, obj});
       // push arguments for evaluate and return
       // this evaluates the operation and finally stores it in the return value container
       return tCall(cont(evaluate), cont(evaluate_Part1), {env, operation});
     }
+    // analyzed syntax, evaluated right away without another trip through the trampoline
+    case scm::TAG_SPECIAL_FORM:
+      pushFrame({env, obj});
+      return specialFormSyntax();
     default:
       schemeThrow("evaluation not yet implemented for " + scm::toString(obj));
   }
@@ -374,7 +325,7 @@ Continuation* evaluate()
 /**
  * Continuation of evaluate, handles evaluation of functions and syntax.
  * Writes restul to `lastReturnValue`.
- * Expects parameters as pop from the argument stack.
+ * Expects its frame on the frame stack: {env, obj}
  * @param env the environment in which tho evaluate the object
  * @param obj the object to be evaluated
  * @returns the next function on the function stack or another continuation function
@@ -383,8 +334,9 @@ static Continuation* evaluate_Part1()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: evaluate part1");
   // get arguments from stack
-  Environment* env{popArg<Environment*>()};
-  Object* obj{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* obj{frame.expression};
 
   // get previously evaluated operation
   Object* evaluatedOperation{lastReturnValue};
@@ -395,7 +347,7 @@ static Continuation* evaluate_Part1()
             toString(getCar(obj)).c_str(),
             toString(argumentCons).c_str());
 
-  switch (evaluatedOperation->tag) {
+  switch (getTag(evaluatedOperation)) {
     case TAG_FUNC_BUILTIN:
       // evaluate arguments first then continue with function evaluation
       return tCall(cont(evaluateArguments),
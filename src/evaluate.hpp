@@ -12,6 +12,8 @@ inline void push(ObjectStack& stack, Object* obj);
 void push(ObjectStack& stack, ObjectVec objects);
 Continuation* evaluate();
 Object* evaluateExpression(Environment& env, Object* obj);
+Object* interpretExpression(Environment& env, Object* obj);
+Object* applyBuiltinFunction(Object* function, int nArgs);
 
 }  // namespace trampoline
 }  // namespace scm
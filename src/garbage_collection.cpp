@@ -1,133 +1,1343 @@
 #include "garbage_collection.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <loguru.hpp>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 #include "environment.hpp"
+#include "heap.hpp"
 #include "scheme.hpp"
+#include "trampoline.hpp"
+#include "vm.hpp"
 
 namespace scm {
 
-// keep track of how many objects we've created in the lifetime of the program
-static int totalObjectCount{0};
+/**
+ * Decides when the next collection takes place. A full collection is due once the heap has grown
+ * by `growthFactor` over the size that survived the previous one, but never below `minHeapSize`.
+ * In between, the young generation is collected whenever `nurserySize` bytes were allocated, a
+ * `nurserySize` of 0 turns collections of only the young generation off.
+ * A `sliceBudget` above zero makes full collections incremental, the mutator is then never paused
+ * for much longer than that many microseconds at a time. Stop the world collections mark with
+ * `markingThreads` threads and move cons cells together if `compactConsCells` is set, otherwise
+ * they leave the sweep to the allocator if `lazySweep` is set. Empty chunks are released once less
+ * than `shrinkWatermark` of the memory held by the heap is in use after a collection.
+ */
+struct CollectionPolicy {
+  double growthFactor;
+  std::size_t minHeapSize;
+  std::size_t nurserySize;
+  long sliceBudget;
+  int markingThreads;
+  bool compactConsCells;
+  bool lazySweep;
+  double shrinkWatermark;
+};
+
+static CollectionPolicy policy{2.0, 1024 * 1024, 256 * 1024, 0, 1, false, true, 0.5};
+// an incremental collection performs a slice whenever this many bytes were allocated
+static constexpr std::size_t SLICE_ALLOCATION{32 * 1024};
+// the time budget of a slice of a lazy sweep, in microseconds
+static constexpr long LAZY_SWEEP_BUDGET{500};
+// the clock is only read after this many objects were marked or swept
+static constexpr int SLICE_CHECK_INTERVAL{64};
+// the number of allocated bytes at which the next full collection takes place
+static std::size_t collectionThreshold{policy.minHeapSize};
+// the number of allocated bytes right after the most recent collection of any kind
+static std::size_t bytesAfterLastCollection{0};
+// top level environments, everything reachable from them survives a collection
+static std::vector<Environment*> rootEnvironments;
+
+// everything allocated since the last collection, the young generation
+static std::vector<Collectable*> youngObjects;
+// old collectables that were made to refer to young ones, see writeBarrier
+static std::vector<Collectable*> rememberedSet;
+// while the young generation is collected, old collectables count as marked
+static bool collectingYoungGeneration{false};
+
+CollectionPhase collectionPhase{PHASE_IDLE};
+// the number of allocated bytes at which an incremental collection performs its next slice
+static std::size_t nextSliceAt{0};
+
+/**
+ * Where an incremental sweep continues, it walks the chunks that existed when marking finished.
+ * Cells are visited backwards from the bump pointer a chunk had when its sweep started.
+ */
+struct SweepCursor {
+  std::size_t chunk;
+  std::size_t nChunks;
+  // NULL until the sweep of the current chunk starts
+  char* cell;
+};
+
+static SweepCursor sweepCursor{0, 0, NULL};
+// the number of objects swept and deleted per type during the current incremental collection
+static int nSweptObjects{0};
+static std::array<int, TAG_ENVIRONMENT + 1> nSweptUnreachable{};
+
+static CollectionStatistics statistics{};
+
+// collectables that are already marked but whose references haven't been followed yet
+// marking never recurses, so deep or long structures can't overflow the native stack
+static std::vector<Collectable*> markStack;
 
-// keep track of all existing objects
-std::vector<Collectable*> ObjectHeap;
+/**
+ * The mark queues of a single thread of a parallel mark phase. The thread works off its private
+ * stack without any locking. Part of it is moved to the shared queue whenever that one runs
+ * empty, other threads that are out of work steal from there.
+ */
+struct MarkWorker {
+  std::vector<Collectable*> stack;
+  std::mutex mutex;
+  std::deque<Collectable*> shared;
+  // the size of the shared queue, readable without taking the lock
+  std::atomic<std::size_t> nShared{0};
+};
+
+// the mark queues of the current thread while marking in parallel, NULL otherwise
+static thread_local MarkWorker* currentMarkWorker{NULL};
+// a thread only shares work if it has more than this many collectables left to scan
+static constexpr std::size_t SHARE_THRESHOLD{64};
 
-// constructor and destructor for Collectable class
-Collectable::Collectable() : marked(false)
+/**
+ * Constructor for Collectable class.
+ * Collectables created during an incremental collection survive it. While marking they're queued
+ * for scanning, as their references are stored without passing the write barrier.
+ */
+Collectable::Collectable(ObjectTypeTag tag)
+    : tag(tag), essential(false), old(false), remembered(false)
 {
-  id = totalObjectCount++;
-  // keep track of the newly created object
-  ObjectHeap.push_back(this);
-  DLOG_IF_F(
-      INFO, LOG_GARBAGE_COLLECTION, "create Obj:%d (marked: %d)", static_cast<int>(id), marked);
+  if (collectionPhase != PHASE_IDLE) {
+    heap::setMarked(this, true);
+  }
+  if (collectionPhase == PHASE_MARKING) {
+    markStack.push_back(this);
+  }
+  DLOG_IF_F(INFO, LOG_GARBAGE_COLLECTION, "create Obj:%p", static_cast<void*>(this));
 }
 
-Collectable::~Collectable()
+/**
+ * Allocate memory for a new collectable in the chunks of our heap.
+ * All objects are therefore enumerable by walking the chunks.
+ * @param size the size of the object
+ * @returns a pointer to the uninitialized memory
+ */
+void* Collectable::operator new(std::size_t size)
 {
-  DLOG_IF_F(ERROR, LOG_GARBAGE_COLLECTION, "delete Obj:%d", static_cast<int>(id));
+  void* cell{heap::allocate(size)};
+  youngObjects.push_back(static_cast<Collectable*>(cell));
+  return cell;
 }
 
 /**
- * Marks a scheme object as not to be deleted during garbage collection.
- * Will recursively call itself in case of cons objects.
- * @param obj the pointer to an object that's to be marked.
+ * Return the memory of a destroyed collectable to its size class.
+ * @param ptr the memory of the destroyed object
+ * @param size the size of the object
  */
-void markSchemeObject(Object* obj)
+void Collectable::operator delete(void* ptr, std::size_t size)
+{
+  heap::release(ptr, size);
+}
+
+/**
+ * Record an old collectable that now refers to a young one. Its references are treated as roots
+ * by the next collection of the young generation.
+ * @param holder the old object or environment that was written to
+ */
+void rememberCollectable(Collectable* holder)
+{
+  if (!holder->remembered) {
+    holder->remembered = true;
+    rememberedSet.push_back(holder);
+  }
+}
+
+/**
+ * Mark an object or environment and remember it, so its references are followed later on.
+ * Old collectables are skipped while only the young generation is collected. When marking in
+ * parallel, it's remembered in the queues of the current thread.
+ * @param obj the collectable to mark, NULL is ignored
+ */
+static void markCollectable(Collectable* obj)
+{
+  if (obj == NULL || heap::isMarked(obj) || (collectingYoungGeneration && obj->old)) {
+    return;
+  }
+  if (currentMarkWorker != NULL) {
+    // another marking thread may have reached the collectable in the meantime
+    if (heap::markAtomically(obj)) {
+      currentMarkWorker->stack.push_back(obj);
+    }
+    return;
+  }
+  heap::setMarked(obj, true);
+  markStack.push_back(obj);
+}
+
+/**
+ * Mark a collectable that was stored into an already marked one while an incremental collection
+ * is marking, see writeBarrier.
+ * @param obj the stored object or environment
+ */
+void shadeCollectable(Collectable* obj)
+{
+  markCollectable(obj);
+}
+
+/**
+ * Mark a scheme object and remember it, so its references are followed later on.
+ * @param obj the object to mark, NULL is ignored
+ */
+static void markValue(Object* obj)
+{
+  // fixnums and singletons live in the value word itself, there's nothing to mark
+  if (obj != NULL && isHeapObject(obj)) {
+    markCollectable(obj);
+  }
+}
+
+/**
+ * Mark all objects and environments a scheme object refers to.
+ * @param obj the object whose references are followed
+ */
+static void scanObject(Object* obj)
 {
   switch (getTag(obj)) {
-    // in most cases, simply mark the object
-    case TAG_INT:
     case TAG_FLOAT:
     case TAG_STRING:
     case TAG_SYMBOL:
-    case TAG_NIL:
-    case TAG_TRUE:
-    case TAG_FALSE:
-    case TAG_VOID:
-    case TAG_EOF:
     case TAG_FUNC_BUILTIN:
     case TAG_SYNTAX:
-      obj->marked = true;
       break;
-    // user functions consist of two cons objects, the argument and bodylist
+    // user functions keep their code and the environment they were created in alive
     case TAG_FUNC_USER:
-      markSchemeObject(getUserFunctionArgList(obj));
-      markSchemeObject(getUserFunctionBodyList(obj));
+      markValue(getUserFunctionArgList(obj));
+      markValue(getUserFunctionBodyList(obj));
+      markValue(getUserFunctionSlotNames(obj));
+      markValue(getUserFunctionCode(obj));
+      markCollectable(getUserFunctionParentEnv(obj));
+      break;
+    case TAG_BYTECODE: {
+      BytecodeValue& code{getBytecode(obj)};
+      for (Object* constant : code.constants) {
+        markValue(constant);
+      }
+      markValue(code.argList);
+      markValue(code.bodyList);
+      markValue(code.slotNames);
       break;
-    // recur until we've reached the end of the list
+    }
+    // parts a form doesn't have are NULL
+    case TAG_SPECIAL_FORM: {
+      const SpecialFormValue& form{getSpecialForm(obj)};
+      markValue(form.first);
+      markValue(form.second);
+      markValue(form.third);
+      break;
+    }
+    case TAG_LOCAL_REF:
+      markValue(getLocalRef(obj).symbol);
+      break;
+    // cells of variables that are referenced but not yet defined hold NULL
+    case TAG_GLOBAL_CELL:
+      markValue(getGlobalCell(obj).symbol);
+      markValue(getGlobalCell(obj).value);
+      break;
+    // the cdr is pushed last and therefore scanned next, a list only takes up one entry
     case TAG_CONS:
-      markSchemeObject(getCar(obj));
-      markSchemeObject(getCdr(obj));
+      markValue(getCar(obj));
+      markValue(getCdr(obj));
       break;
-
     default:
-      schemeThrow("tag " + std::to_string(obj->tag) + " isn't handled yet");
+      schemeThrow("tag " + std::to_string(getTag(obj)) + " isn't handled yet");
       break;
   }
-};
+}
+
+/**
+ * Mark all objects and environments an object or environment refers to.
+ * @param obj the collectable whose references are followed
+ */
+static void scanCollectable(Collectable* obj)
+{
+  if (obj->tag == TAG_ENVIRONMENT) {
+    mark(*static_cast<Environment*>(obj));
+  }
+  else {
+    scanObject(static_cast<Object*>(obj));
+  }
+}
+
+/**
+ * Follow the references of the collectables on the mark stack until everything reachable from
+ * them is marked.
+ */
+static void processMarkStack()
+{
+  while (!markStack.empty()) {
+    Collectable* obj{markStack.back()};
+    markStack.pop_back();
+    scanCollectable(obj);
+  }
+}
+
+/**
+ * Follow the references of the collectables on the mark stack until it's empty or the deadline
+ * has passed.
+ * @param deadline the point in time at which marking is interrupted
+ * @returns whether the mark stack is empty
+ */
+static bool processMarkStack(std::chrono::steady_clock::time_point deadline)
+{
+  for (int nScanned{1}; !markStack.empty(); nScanned++) {
+    Collectable* obj{markStack.back()};
+    markStack.pop_back();
+    scanCollectable(obj);
+    if (nScanned % SLICE_CHECK_INTERVAL == 0 && std::chrono::steady_clock::now() >= deadline) {
+      return markStack.empty();
+    }
+  }
+  return true;
+}
+
+/**
+ * Move half of the private mark stack of a thread to its shared queue, if that one is empty.
+ * @param worker the mark queues of the thread
+ */
+static void shareWork(MarkWorker& worker)
+{
+  if (worker.stack.size() <= SHARE_THRESHOLD ||
+      worker.nShared.load(std::memory_order_relaxed) != 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{worker.mutex};
+  auto half{worker.stack.begin() + static_cast<long>(worker.stack.size() / 2)};
+  worker.shared.insert(worker.shared.end(), half, worker.stack.end());
+  worker.stack.erase(half, worker.stack.end());
+  worker.nShared.store(worker.shared.size(), std::memory_order_relaxed);
+}
+
+/**
+ * Move half of the shared queue of a thread, but at least one collectable, onto the private mark
+ * stack of another or the same thread.
+ * @param victim the mark queues to take from
+ * @param thief the mark queues to move the collectables to
+ * @returns false if there was nothing to take
+ */
+static bool takeWork(MarkWorker& victim, MarkWorker& thief)
+{
+  if (victim.nShared.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock{victim.mutex};
+  std::size_t nTaken{(victim.shared.size() + 1) / 2};
+  auto end{victim.shared.begin() + static_cast<long>(nTaken)};
+  thief.stack.insert(thief.stack.end(), victim.shared.begin(), end);
+  victim.shared.erase(victim.shared.begin(), end);
+  victim.nShared.store(victim.shared.size(), std::memory_order_relaxed);
+  return nTaken > 0;
+}
+
+/**
+ * Find work for a thread that has run out of it, its own shared queue is checked first.
+ * @param index the number of the thread
+ * @param workers the mark queues of all threads
+ * @returns false if there was no work left in any queue
+ */
+static bool findWork(std::size_t index, std::vector<std::unique_ptr<MarkWorker>>& workers)
+{
+  for (std::size_t i{0}; i < workers.size(); i++) {
+    if (takeWork(*workers[(index + i) % workers.size()], *workers[index])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * The work loop of a single marking thread. Marking is complete once all threads are idle: an
+ * idle thread's queues are empty, and only a thread that isn't idle can fill its own queues.
+ * @param index the number of the thread
+ * @param workers the mark queues of all threads
+ * @param nIdle the number of threads that ran out of work
+ */
+static void runMarkWorker(std::size_t index,
+                          std::vector<std::unique_ptr<MarkWorker>>& workers,
+                          std::atomic<std::size_t>& nIdle)
+{
+  MarkWorker& worker{*workers[index]};
+  currentMarkWorker = &worker;
+  while (true) {
+    while (!worker.stack.empty() || findWork(index, workers)) {
+      Collectable* obj{worker.stack.back()};
+      worker.stack.pop_back();
+      scanCollectable(obj);
+      shareWork(worker);
+    }
+    nIdle++;
+    while (true) {
+      if (nIdle == workers.size()) {
+        currentMarkWorker = NULL;
+        return;
+      }
+      bool hasWork{std::any_of(workers.begin(), workers.end(), [](auto& other) {
+        return other->nShared.load(std::memory_order_relaxed) != 0;
+      })};
+      if (hasWork) {
+        nIdle--;
+        break;
+      }
+      std::this_thread::yield();
+    }
+  }
+}
+
+/**
+ * Mark everything reachable from the collectables on the mark stack with several threads.
+ * Each thread marks from its own queues and steals from the others once it runs out of work.
+ * Mark bits are set atomically, so every collectable is scanned exactly once.
+ * @param nThreads the number of threads, including the calling one
+ */
+static void markInParallel(int nThreads)
+{
+  std::vector<std::unique_ptr<MarkWorker>> workers;
+  for (int i{0}; i < nThreads; i++) {
+    workers.push_back(std::make_unique<MarkWorker>());
+  }
+  // the roots are dealt out evenly, there's nothing to steal yet
+  for (std::size_t i{0}; i < markStack.size(); i++) {
+    workers[i % workers.size()]->stack.push_back(markStack[i]);
+  }
+  markStack.clear();
+  std::atomic<std::size_t> nIdle{0};
+  std::vector<std::thread> threads;
+  for (std::size_t i{1}; i < workers.size(); i++) {
+    threads.emplace_back(runMarkWorker, i, std::ref(workers), std::ref(nIdle));
+  }
+  runMarkWorker(0, workers, nIdle);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
 
 /**
- * Mark all objects reachable from a given environment as not to be collected.
- * @param env the environment from which an object needs to be reachable in order to be accepted
+ * Marks a scheme object and everything reachable from it as not to be deleted during garbage
+ * collection. Objects that are already marked are skipped, which makes cyclic structures safe.
+ * @param obj the pointer to an object that's to be marked.
+ */
+void markSchemeObject(Object* obj)
+{
+  markValue(obj);
+  processMarkStack();
+}
+
+/**
+ * Mark everything an environment refers to: its bindings, the local variables of a function call
+ * and its parent environment. The environment itself has to be marked already.
+ * @param env the environment whose references are followed
  */
 void mark(Environment& env)
 {
-  for (auto& binding : env.bindings) {
-    DLOG_IF_F(INFO,
-              LOG_GARBAGE_COLLECTION,
-              "marking binding %s | %s",
-              binding.first.c_str(),
-              toString(binding.second).c_str());
-    markSchemeObject(binding.second);
+  forEachBinding(env.bindings, [](Binding& binding) {
+    markValue(binding.key);
+    markValue(binding.value);
+  });
+  for (Object* slot : env.slots) {
+    markValue(slot);
   }
+  markValue(env.slotNames);
+  markCollectable(env.parentEnv);
 }
 
 /**
- * Delete all objects that weren't marked or aren't essential.
+ * Mark the roots, everything the interpreter can access directly: the registered top level
+ * environments, all objects and environments on the argument stack of the trampoline, the
+ * most recent return value and the code and frames of the calls the virtual machine is running.
+ * The function stack only holds continuations, which aren't heap objects. What the roots refer
+ * to is marked by processing the mark stack afterwards.
+ * When only the young generation is collected, the references of the remembered set are roots
+ * as well, that's how young objects only reachable through old ones are found.
  */
-void sweep()
+static void markRoots()
+{
+  for (Environment* env : rootEnvironments) {
+    markCollectable(env);
+  }
+  if (collectingYoungGeneration) {
+    for (Collectable* holder : rememberedSet) {
+      scanCollectable(holder);
+    }
+  }
+  for (trampoline::Frame& frame : trampoline::frameStack) {
+    markCollectable(frame.env);
+    markValue(frame.expression);
+    markValue(frame.rest);
+  }
+  for (std::size_t i{0}; i < trampoline::valueStack.size; i++) {
+    markValue(trampoline::valueStack.values[i]);
+  }
+  markValue(trampoline::lastReturnValue);
+  for (vm::CallFrame& frame : vm::callStack) {
+    markValue(frame.code);
+    markCollectable(frame.env);
+  }
+}
+
+// cons cells copied by the current compaction whose car still has to be forwarded
+static std::vector<ConsObject*> copiedCells;
+// copied cells whose cdr still has to be forwarded, the last cell of every copied list
+static std::vector<ConsObject*> copiedListEnds;
+
+/**
+ * Copy a marked cons cell to the end of the current chunk of its size class. The original is
+ * unmarked and its car is overwritten with the address of the copy, that's how references to it
+ * are forwarded later on. Unmarked cons cells are never referenced by reachable collectables, so
+ * there's no need for a separate forwarding flag.
+ * @param cons the cell to copy
+ * @returns the copy
+ */
+static ConsObject* copyCons(ConsObject* cons)
+{
+  void* cell{heap::allocateContiguous(sizeof(ConsObject))};
+  ConsObject* copy{::new (cell) ConsObject(cons->value.car, cons->value.cdr)};
+  heap::setMarked(copy, true);
+  heap::setMarked(cons, false);
+  cons->value.car = copy;
+  copiedCells.push_back(copy);
+  return copy;
+}
+
+/**
+ * Get the new address of a referenced object. A cons cell that wasn't moved yet is copied right
+ * away, followed by the rest of its list, so lists end up in consecutive cells in the order in
+ * which they're traversed.
+ * @param obj the referenced object
+ * @returns the address of the object after the compaction
+ */
+static Object* forwardCons(Object* obj)
+{
+  if (obj == NULL || !isHeapObject(obj) || getTag(obj) != TAG_CONS || obj->essential) {
+    return obj;
+  }
+  ConsObject* cons{static_cast<ConsObject*>(obj)};
+  if (!heap::isMarked(cons)) {
+    return cons->value.car;
+  }
+  ConsObject* head{copyCons(cons)};
+  ConsObject* copy{head};
+  Object* next{copy->value.cdr};
+  while (next != NULL && isHeapObject(next) && getTag(next) == TAG_CONS && !next->essential &&
+         heap::isMarked(next)) {
+    copy->value.cdr = copyCons(static_cast<ConsObject*>(next));
+    copy = static_cast<ConsObject*>(copy->value.cdr);
+    next = copy->value.cdr;
+  }
+  copiedListEnds.push_back(copy);
+  return head;
+}
+
+/**
+ * Forward all references of an environment to moved cons cells.
+ * @param env the environment whose references are updated
+ */
+void forwardReferences(Environment& env)
+{
+  forEachBinding(env.bindings,
+                 [](Binding& binding) { binding.value = forwardCons(binding.value); });
+  for (Object*& slot : env.slots) {
+    slot = forwardCons(slot);
+  }
+  env.slotNames = forwardCons(env.slotNames);
+}
+
+/**
+ * Forward all references of an object to moved cons cells. Cons cells themselves are handled by
+ * compactConsCells.
+ * @param obj the object whose references are updated
+ */
+static void forwardReferences(Object* obj)
+{
+  switch (getTag(obj)) {
+    case TAG_FUNC_USER: {
+      UserFuncValue& function{static_cast<UserFuncObject*>(obj)->value};
+      function.argList = forwardCons(function.argList);
+      function.bodyList = forwardCons(function.bodyList);
+      function.slotNames = forwardCons(function.slotNames);
+      break;
+    }
+    case TAG_GLOBAL_CELL:
+      getGlobalCell(obj).value = forwardCons(getGlobalCell(obj).value);
+      break;
+    case TAG_BYTECODE: {
+      BytecodeValue& code{getBytecode(obj)};
+      for (Object*& constant : code.constants) {
+        constant = forwardCons(constant);
+      }
+      code.argList = forwardCons(code.argList);
+      code.bodyList = forwardCons(code.bodyList);
+      code.slotNames = forwardCons(code.slotNames);
+      break;
+    }
+    case TAG_SPECIAL_FORM: {
+      SpecialFormValue& form{static_cast<SpecialFormObject*>(obj)->value};
+      form.first = forwardCons(form.first);
+      form.second = forwardCons(form.second);
+      form.third = forwardCons(form.third);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+/**
+ * Move all reachable cons cells into fresh chunks, so the cells of a list are adjacent and in
+ * order. Lists scattered over the heap by many allocations and collections are walked far
+ * faster afterwards. Must be called after marking and before sweeping, the original cells are
+ * unmarked and therefore freed by the sweep.
+ * References are forwarded in a Cheney style scan: first those of the roots and of all other
+ * collectables, which copies the lists they refer to, then those of the copies themselves until
+ * no more cells are copied.
+ */
+static void compactConsCells()
 {
-  int nObjectsBefore{static_cast<int>(ObjectHeap.size())};
-  for (auto i = ObjectHeap.begin(); i != ObjectHeap.end();) {
-    if (!(*i)->marked && !(*i)->essential) {
-      DLOG_IF_F(INFO,
-                LOG_GARBAGE_COLLECTION,
-                "delete %s %s",
-                tagToString(getTag((Object*)(*i))).c_str(),
-                toString((Object*)(*i)).c_str());
-      // TODO: this doesn't seem to work yet -> no deleting as of yet :)
-      // delete *i;
-      i = ObjectHeap.erase(i);
+  std::vector<Collectable*> holders;
+  heap::forEachObject([&holders](Collectable* obj) {
+    if (heap::isMarked(obj) && obj->tag != TAG_CONS) {
+      holders.push_back(obj);
+    }
+  });
+  for (trampoline::Frame& frame : trampoline::frameStack) {
+    frame.expression = forwardCons(frame.expression);
+    frame.rest = forwardCons(frame.rest);
+  }
+  for (std::size_t i{0}; i < trampoline::valueStack.size; i++) {
+    trampoline::valueStack.values[i] = forwardCons(trampoline::valueStack.values[i]);
+  }
+  trampoline::lastReturnValue = forwardCons(trampoline::lastReturnValue);
+  for (Collectable* holder : holders) {
+    if (holder->tag == TAG_ENVIRONMENT) {
+      forwardReferences(*static_cast<Environment*>(holder));
+    }
+    else {
+      forwardReferences(static_cast<Object*>(holder));
+    }
+  }
+  for (std::size_t i{0}, j{0}; i < copiedCells.size() || j < copiedListEnds.size();) {
+    if (i < copiedCells.size()) {
+      copiedCells[i]->value.car = forwardCons(copiedCells[i]->value.car);
+      i++;
     }
     else {
-      DLOG_IF_F(INFO,
-                LOG_GARBAGE_COLLECTION,
-                "keep %s %s",
-                tagToString(((Object*)(*i))->tag).c_str(),
-                toString((Object*)(*i)).c_str());
-      (*i)->marked = false;
-      ++i;
+      copiedListEnds[j]->value.cdr = forwardCons(copiedListEnds[j]->value.cdr);
+      j++;
+    }
+  }
+  DLOG_IF_F(INFO,
+            LOG_GARBAGE_COLLECTION,
+            "moved %d cons cells",
+            static_cast<int>(copiedCells.size()));
+  copiedCells.clear();
+  copiedListEnds.clear();
+}
+
+/**
+ * Destroy an unreachable collectable and return its memory to the heap.
+ * @param obj the object or environment to destroy
+ */
+static void destroyCollectable(Collectable* obj)
+{
+  if (obj->tag == TAG_ENVIRONMENT) {
+    delete static_cast<Environment*>(obj);
+    return;
+  }
+  destroyObject(static_cast<Object*>(obj));
+}
+
+/**
+ * Delete a collectable if it wasn't marked and isn't essential, otherwise promote it to the old
+ * generation and clear its mark for the next collection.
+ * @param obj the object or environment to check
+ * @param nUnreachable the number of deleted collectables per type, updated accordingly
+ */
+static void sweepCollectable(Collectable* obj, std::array<int, TAG_ENVIRONMENT + 1>& nUnreachable)
+{
+  if (!heap::isMarked(obj) && !obj->essential) {
+    nUnreachable[obj->tag]++;
+    destroyCollectable(obj);
+  }
+  else {
+    heap::setMarked(obj, false);
+    // the header of an old collectable isn't written to, its page may be shared with a fork
+    if (!obj->old) {
+      obj->old = true;
+    }
+  }
+}
+
+/**
+ * Log the result of a sweep.
+ * @param nObjects the number of visited objects
+ * @param nUnreachable the number of deleted collectables per type
+ */
+static void logSweep([[maybe_unused]] int nObjects,
+                     const std::array<int, TAG_ENVIRONMENT + 1>& nUnreachable)
+{
+  if (LOG_GARBAGE_COLLECTION) {
+    for (int tag{1}; tag < static_cast<int>(nUnreachable.size()); tag++) {
+      if (nUnreachable[tag] > 0) {
+        DLOG_F(INFO,
+               "deleted %d %s objects",
+               nUnreachable[tag],
+               tagToString(static_cast<ObjectTypeTag>(tag)).c_str());
+      }
     }
   }
-  int nObjectsAfter{static_cast<int>(ObjectHeap.size())};
   DLOG_IF_F(WARNING,
             LOG_GARBAGE_COLLECTION,
             "cleaned up %d/%d objects",
-            nObjectsBefore - nObjectsAfter,
-            nObjectsBefore);
+            std::accumulate(nUnreachable.begin(), nUnreachable.end(), 0),
+            nObjects);
 }
 
 /**
- * Check which objects are still reachable from a given environment and delete the rest.
- * Implementation of a simple mark and sweep algorithm.
- * @param env the environment from which the objects need to be reachable in order not to be
- * deleted.
+ * Sweep the heap from where the last slice stopped until all chunks are swept or the deadline
+ * has passed. Chunks created during the collection only hold collectables allocated since its
+ * start, which survive anyway.
+ * @param deadline the point in time at which sweeping is interrupted
+ * @param chunkLimit the index of the first chunk not to be swept by this call
+ * @returns whether the sweep is complete
  */
-void markAndSweep(Environment& env)
+static bool sweepIncrementally(std::chrono::steady_clock::time_point deadline,
+                               std::size_t chunkLimit)
 {
-  mark(env);
+  const std::vector<heap::Chunk*>& chunks{heap::getChunks()};
+  for (; sweepCursor.chunk < std::min(chunkLimit, sweepCursor.nChunks); sweepCursor.chunk++) {
+    heap::Chunk* chunk{chunks[sweepCursor.chunk]};
+    if (sweepCursor.cell == NULL) {
+      sweepCursor.cell = chunk->bump;
+    }
+    while (sweepCursor.cell > chunk->begin) {
+      sweepCursor.cell -= chunk->cellSize;
+      if (heap::isLiveCell(sweepCursor.cell)) {
+        sweepCollectable(reinterpret_cast<Collectable*>(sweepCursor.cell), nSweptUnreachable);
+        if (++nSweptObjects % SLICE_CHECK_INTERVAL == 0 &&
+            std::chrono::steady_clock::now() >= deadline) {
+          return false;
+        }
+      }
+    }
+    sweepCursor.cell = NULL;
+  }
+  return sweepCursor.chunk >= sweepCursor.nChunks;
+}
+
+/**
+ * Sweep the rest of the chunk the cursor is in. Installed as the sweeper of the heap while a
+ * collection is sweeping, so a size class that ran out of cells gets freed ones before the heap
+ * grows by another chunk.
+ * @returns false if the sweep is already complete
+ */
+static bool sweepForAllocation()
+{
+  if (sweepCursor.chunk >= sweepCursor.nChunks) {
+    return false;
+  }
+  sweepIncrementally(std::chrono::steady_clock::time_point::max(), sweepCursor.chunk + 1);
+  return true;
+}
+
+/**
+ * Delete all objects and environments that weren't marked or aren't essential.
+ * Every cell of the heap is visited exactly once, freed cells go back to the free lists of their
+ * size class. Only the young generation is visited if that's all that was marked.
+ * Only the number of objects per type is logged, as converting every single object to a string
+ * would cost far more than the sweep itself.
+ */
+void sweep()
+{
+  int nObjects{0};
+  std::array<int, TAG_ENVIRONMENT + 1> nUnreachable{};
+  if (collectingYoungGeneration) {
+    // younger objects come last, walk backwards like the full sweep does
+    for (auto obj{youngObjects.rbegin()}; obj != youngObjects.rend(); obj++) {
+      nObjects++;
+      sweepCollectable(*obj, nUnreachable);
+    }
+  }
+  else {
+    heap::forEachObjectBackwards([&nObjects, &nUnreachable](Collectable* obj) {
+      nObjects++;
+      sweepCollectable(obj, nUnreachable);
+    });
+  }
+  logSweep(nObjects, nUnreachable);
+}
+
+/**
+ * Empty the remembered set. This has to happen before sweeping, as remembered collectables may
+ * be unreachable by now.
+ */
+static void forgetRememberedSet()
+{
+  for (Collectable* holder : rememberedSet) {
+    holder->remembered = false;
+  }
+  rememberedSet.clear();
+}
+
+/**
+ * Forget the young generation, everything that survived a collection is old from now on.
+ */
+static void finishCollection()
+{
+  youngObjects.clear();
+  bytesAfterLastCollection = heap::getAllocatedBytes();
+}
+
+/**
+ * Give empty chunks back to the operating system if less than the watermark of the policy is in
+ * use, so the process shrinks again after a spike in memory usage.
+ */
+static void shrinkHeap()
+{
+  if (static_cast<double>(heap::getAllocatedBytes()) <
+      policy.shrinkWatermark * static_cast<double>(heap::getMappedBytes())) {
+    heap::releaseEmptyChunks();
+  }
+}
+
+/**
+ * Set the threshold for the next full collection according to the policy.
+ */
+static void updateCollectionThreshold()
+{
+  collectionThreshold =
+      std::max(policy.minHeapSize,
+               static_cast<std::size_t>(static_cast<double>(bytesAfterLastCollection) *
+                                        policy.growthFactor));
+  DLOG_IF_F(INFO,
+            LOG_GARBAGE_COLLECTION,
+            "%d bytes survived, next collection at %d bytes",
+            static_cast<int>(bytesAfterLastCollection),
+            static_cast<int>(collectionThreshold));
+}
+
+/**
+ * Start an incremental collection. The young generation and the remembered set are forgotten,
+ * the collection treats every collectable alike and promotes whatever survives it.
+ */
+static void startIncrementalCollection()
+{
+  youngObjects.clear();
+  forgetRememberedSet();
+  collectionPhase = PHASE_MARKING;
+  nSweptObjects = 0;
+  nSweptUnreachable.fill(0);
+  markRoots();
+  statistics.nFullCollections++;
+  DLOG_IF_F(INFO, LOG_GARBAGE_COLLECTION, "incremental collection started");
+}
+
+/**
+ * Start sweeping the chunks that exist once marking is done. The sweep proceeds in slices and
+ * whenever the allocator runs out of free cells.
+ */
+static void startSweeping()
+{
+  collectionPhase = PHASE_SWEEPING;
+  sweepCursor = {0, heap::getChunks().size(), NULL};
+  heap::setSweeper(sweepForAllocation);
+}
+
+/**
+ * Complete the marking of an incremental collection and prepare the sweep. The roots are scanned
+ * once more, as the argument stack of the trampoline is changed without passing the write
+ * barrier. This step isn't interrupted, but only has to mark what became reachable during the
+ * collection.
+ */
+static void finishMarking()
+{
+  markRoots();
+  processMarkStack();
+  startSweeping();
+}
+
+/**
+ * Start a collection that marks everything at once, but leaves the sweep to the allocator and
+ * the following slices. The pause only takes as long as marking, which is proportional to the
+ * live data, not to the size of the heap.
+ */
+static void startLazyCollection()
+{
+  youngObjects.clear();
+  forgetRememberedSet();
+  nSweptObjects = 0;
+  nSweptUnreachable.fill(0);
+  markRoots();
+  if (policy.markingThreads > 1) {
+    markInParallel(policy.markingThreads);
+  }
+  else {
+    processMarkStack();
+  }
+  startSweeping();
+  statistics.nFullCollections++;
+  DLOG_IF_F(INFO, LOG_GARBAGE_COLLECTION, "marked, sweeping lazily");
+}
+
+/**
+ * Finish an incremental or lazily swept collection once the sweep is complete. Collectables
+ * created during the collection survived it, they're promoted as well, so no old collectable
+ * refers to a young one.
+ */
+static void finishIncrementalCollection()
+{
+  for (Collectable* obj : youngObjects) {
+    heap::setMarked(obj, false);
+    obj->old = true;
+  }
+  collectionPhase = PHASE_IDLE;
+  heap::setSweeper(NULL);
+  logSweep(nSweptObjects, nSweptUnreachable);
+  shrinkHeap();
+  finishCollection();
+  updateCollectionThreshold();
+}
+
+/**
+ * Perform a single step of an incremental collection, taking roughly the time budget of the
+ * policy. Must only be called between two steps of the trampoline.
+ */
+void performCollectionSlice()
+{
+  statistics.nSlices++;
+  long budget{policy.sliceBudget > 0 ? policy.sliceBudget : LAZY_SWEEP_BUDGET};
+  auto deadline{std::chrono::steady_clock::now() + std::chrono::microseconds(budget)};
+  if (collectionPhase == PHASE_MARKING) {
+    if (!processMarkStack(deadline)) {
+      return;
+    }
+    finishMarking();
+  }
+  if (collectionPhase == PHASE_SWEEPING && sweepIncrementally(deadline, sweepCursor.nChunks)) {
+    finishIncrementalCollection();
+  }
+}
+
+/**
+ * Check which objects are still reachable and delete the rest.
+ * Implementation of a simple mark and sweep algorithm. It must only be called between two steps
+ * of the trampoline, as objects held in local variables of a running function aren't roots and
+ * cons cells may be moved. An incremental collection that's in progress is completed first.
+ * Afterwards the threshold for the next collection is set according to the policy.
+ */
+void collectGarbage()
+{
+  if (collectionPhase == PHASE_MARKING) {
+    finishMarking();
+  }
+  if (collectionPhase == PHASE_SWEEPING) {
+    sweepIncrementally(std::chrono::steady_clock::time_point::max(), sweepCursor.nChunks);
+    finishIncrementalCollection();
+  }
+  markRoots();
+  if (policy.markingThreads > 1) {
+    markInParallel(policy.markingThreads);
+  }
+  else {
+    processMarkStack();
+  }
+  forgetRememberedSet();
+  if (policy.compactConsCells) {
+    compactConsCells();
+  }
+  sweep();
+  // the chunks the cons cells were moved out of are often empty now
+  if (policy.compactConsCells) {
+    heap::releaseEmptyChunks();
+  }
+  else {
+    shrinkHeap();
+  }
+  finishCollection();
+  updateCollectionThreshold();
+  statistics.nFullCollections++;
+}
+
+/**
+ * Collect only the objects allocated since the last collection. Most of them are temporary
+ * values that are already unreachable, so this is far cheaper than a full collection: the old
+ * generation is neither marked nor swept. Old objects referring to young ones are known from the
+ * write barrier. Everything surviving is promoted to the old generation.
+ */
+void collectYoungGeneration()
+{
+  collectingYoungGeneration = true;
+  markRoots();
+  processMarkStack();
+  forgetRememberedSet();
   sweep();
+  collectingYoungGeneration = false;
+  finishCollection();
+  statistics.nYoungCollections++;
+  DLOG_IF_F(INFO,
+            LOG_GARBAGE_COLLECTION,
+            "young generation collected, %d bytes in use",
+            static_cast<int>(bytesAfterLastCollection));
+}
+
+// a piece of collection work done at a safepoint
+using CollectionWork = void (*)();
+
+/**
+ * Find out which collection work is due, if any.
+ * With a time budget, full collections are spread over many slices. Otherwise they're swept
+ * lazily unless cons cells are compacted. Should the mutator allocate faster than such a
+ * collection makes progress, it's completed at once.
+ * @param allocatedBytes the number of bytes currently allocated
+ * @returns the work to do, NULL if nothing is due
+ */
+static CollectionWork findDueWork(std::size_t allocatedBytes)
+{
+  if (collectionPhase != PHASE_IDLE) {
+    bool isSwept{collectionPhase == PHASE_SWEEPING && sweepCursor.chunk >= sweepCursor.nChunks};
+    if (allocatedBytes >= 2 * collectionThreshold) {
+      return collectGarbage;
+    }
+    if (isSwept || allocatedBytes >= nextSliceAt) {
+      return performCollectionSlice;
+    }
+    return NULL;
+  }
+  if (allocatedBytes >= collectionThreshold) {
+    if (policy.sliceBudget > 0) {
+      return []() {
+        startIncrementalCollection();
+        performCollectionSlice();
+      };
+    }
+    if (policy.lazySweep && !policy.compactConsCells) {
+      return startLazyCollection;
+    }
+    return collectGarbage;
+  }
+  // at least one byte has to be allocated, a safepoint without allocation has nothing to collect
+  if (policy.nurserySize > 0 && allocatedBytes >= bytesAfterLastCollection + policy.nurserySize) {
+    return collectYoungGeneration;
+  }
+  return NULL;
+}
+
+/**
+ * Record how long the mutator was paused for collection work.
+ * @param microseconds the duration of the pause
+ */
+static void recordPause(double microseconds)
+{
+  statistics.nPauses++;
+  statistics.totalPauseMicroseconds += microseconds;
+  statistics.maxPauseMicroseconds = std::max(statistics.maxPauseMicroseconds, microseconds);
+  int bucket{0};
+  for (double limit{10}; bucket < N_PAUSE_BUCKETS - 1 && microseconds >= limit; limit *= 10) {
+    bucket++;
+  }
+  statistics.pauseHistogram[bucket]++;
+}
+
+/**
+ * Collect garbage if enough memory was allocated since the last collection. This is the safepoint
+ * of the trampoline, it's checked before every step. The clock is only read if there's work to
+ * do, the resulting pause is recorded in the statistics.
+ */
+void collectGarbageIfDue()
+{
+  CollectionWork work{findDueWork(heap::getAllocatedBytes())};
+  if (work == NULL) {
+    return;
+  }
+  auto start{std::chrono::steady_clock::now()};
+  work();
+  if (collectionPhase != PHASE_IDLE) {
+    nextSliceAt = heap::getAllocatedBytes() + SLICE_ALLOCATION;
+  }
+  std::chrono::duration<double, std::micro> pause{std::chrono::steady_clock::now() - start};
+  recordPause(pause.count());
+}
+
+/**
+ * Register a top level environment as a root of the garbage collector.
+ * @param env the environment to keep alive
+ */
+void addRootEnvironment(Environment* env)
+{
+  rootEnvironments.push_back(env);
+}
+
+/**
+ * Remove a top level environment from the roots, it's collected once nothing refers to it.
+ * @param env the environment that was registered before
+ */
+void removeRootEnvironment(Environment* env)
+{
+  rootEnvironments.erase(std::remove(rootEnvironments.begin(), rootEnvironments.end(), env),
+                         rootEnvironments.end());
+}
+
+/**
+ * Change the number of threads stop the world collections mark with.
+ * @param nThreads the new number of threads, at least one
+ * @returns the previous number of threads
+ */
+int setMarkingThreads(int nThreads)
+{
+  int previous{policy.markingThreads};
+  policy.markingThreads = std::max(nThreads, 1);
+  return previous;
+}
+
+/**
+ * Turn the compaction of cons cells during stop the world collections on or off.
+ * @param enabled whether cons cells are to be compacted
+ * @returns whether they were compacted before
+ */
+bool setConsCompaction(bool enabled)
+{
+  bool previous{policy.compactConsCells};
+  policy.compactConsCells = enabled;
+  return previous;
+}
+
+/**
+ * Get what the collector did so far.
+ * @returns the statistics since the start of the interpreter
+ */
+const CollectionStatistics& getCollectionStatistics()
+{
+  return statistics;
+}
+
+/**
+ * Is the cell garbage that a lazy or incremental sweep hasn't reached yet?
+ * @param chunkIndex the index of the chunk holding the cell
+ * @param cell the cell to check, must be live
+ * @returns whether the cell is going to be freed by the running sweep
+ */
+static bool isAwaitingSweep(std::size_t chunkIndex, const char* cell)
+{
+  if (collectionPhase != PHASE_SWEEPING || chunkIndex < sweepCursor.chunk ||
+      chunkIndex >= sweepCursor.nChunks) {
+    return false;
+  }
+  // each chunk is swept backwards from its bump pointer
+  if (chunkIndex == sweepCursor.chunk && sweepCursor.cell != NULL && cell >= sweepCursor.cell) {
+    return false;
+  }
+  return !heap::isMarked(cell) && !reinterpret_cast<const Collectable*>(cell)->essential;
+}
+
+/**
+ * Count the objects on the heap and the bytes they take up, per type. Garbage that's known to be
+ * unreachable but wasn't swept yet isn't counted.
+ * @returns one entry per ObjectTypeTag, indexed by the tag
+ */
+std::vector<CensusEntry> takeHeapCensus()
+{
+  std::vector<CensusEntry> census(TAG_ENVIRONMENT + 1, CensusEntry{0, 0});
+  const std::vector<heap::Chunk*>& chunks{heap::getChunks()};
+  for (std::size_t i{0}; i < chunks.size(); i++) {
+    heap::Chunk* chunk{chunks[i]};
+    for (char* cell{chunk->begin}; cell < chunk->bump; cell += chunk->cellSize) {
+      if (heap::isLiveCell(cell) && !isAwaitingSweep(i, cell)) {
+        CensusEntry& entry{census[reinterpret_cast<Collectable*>(cell)->tag]};
+        entry.nObjects++;
+        entry.nBytes += chunk->cellSize;
+      }
+    }
+  }
+  return census;
+}
+
+/**
+ * Write the collection statistics, the size of the heap and a census of its objects as a single
+ * JSON object, so they can be processed by other tools.
+ * @param stream the stream to write to
+ */
+void writeStatisticsJson(std::ostream& stream)
+{
+  const char* bucketNames[N_PAUSE_BUCKETS]{"<10us", "<100us", "<1ms", "<10ms", "<100ms", ">=100ms"};
+  stream << "{\"full_collections\": " << statistics.nFullCollections
+         << ", \"young_collections\": " << statistics.nYoungCollections
+         << ", \"slices\": " << statistics.nSlices << ", \"pauses\": " << statistics.nPauses
+         << ", \"pause_total_us\": " << statistics.totalPauseMicroseconds
+         << ", \"pause_max_us\": " << statistics.maxPauseMicroseconds
+         << ", \"pause_histogram\": {";
+  for (int bucket{0}; bucket < N_PAUSE_BUCKETS; bucket++) {
+    stream << (bucket > 0 ? ", " : "") << '"' << bucketNames[bucket]
+           << "\": " << statistics.pauseHistogram[bucket];
+  }
+  stream << "}, \"bytes_allocated\": " << heap::getTotalAllocatedBytes()
+         << ", \"bytes_in_use\": " << heap::getAllocatedBytes()
+         << ", \"heap_bytes\": " << heap::getMappedBytes() << ", \"census\": {";
+  std::vector<CensusEntry> census{takeHeapCensus()};
+  bool isFirst{true};
+  for (int tag{1}; tag < static_cast<int>(census.size()); tag++) {
+    if (census[tag].nObjects > 0) {
+      stream << (isFirst ? "" : ", ") << '"' << tagToString(static_cast<ObjectTypeTag>(tag))
+             << "\": {\"objects\": " << census[tag].nObjects
+             << ", \"bytes\": " << census[tag].nBytes << '}';
+      isFirst = false;
+    }
+  }
+  stream << "}}\n";
+}
+
+/**
+ * Print the statistics as JSON to the standard error stream, registered to run at exit.
+ */
+static void reportStatisticsAtExit()
+{
+  writeStatisticsJson(std::cerr);
+}
+
+/**
+ * Set up the report printed when the interpreter exits.
+ * @param name the name of the setting, used for the warning
+ * @param format the format of the report, only json is supported
+ */
+static void configureStatisticsReport(const std::string& name, const std::string& format)
+{
+  static bool isRegistered{false};
+  if (format != "json") {
+    LOG_F(WARNING, "ignoring invalid value for %s: %s", name.c_str(), format.c_str());
+  }
+  else if (!isRegistered) {
+    std::atexit(reportStatisticsAtExit);
+    isRegistered = true;
+  }
+}
+
+/**
+ * Parse a collection policy setting.
+ * @param name the name of the setting, used for the warning
+ * @param value the value to parse
+ * @param setting the setting to overwrite, left untouched if value is invalid
+ * @param minimum the smallest valid value
+ */
+template <typename T>
+static void parseSetting(const std::string& name, const std::string& value, T& setting, T minimum)
+{
+  try {
+    std::size_t parsedLength;
+    double parsed{std::stod(value, &parsedLength)};
+    if (parsedLength != value.size() || parsed < static_cast<double>(minimum)) {
+      throw std::invalid_argument(value);
+    }
+    setting = static_cast<T>(parsed);
+  }
+  catch (std::exception& e) {
+    LOG_F(WARNING, "ignoring invalid value for %s: %s", name.c_str(), value.c_str());
+  }
+}
+
+/**
+ * A setting of the collection policy, given as a command line option or environment variable.
+ */
+struct PolicySetting {
+  std::string option;
+  const char* variable;
+  // parses a value and stores it in the policy, takes the name of the setting and the value
+  std::function<void(const std::string&, const std::string&)> parse;
+};
+
+/**
+ * Describe a setting of the collection policy.
+ * @param option the name of the command line option, the value follows after a '='
+ * @param variable the name of the environment variable
+ * @param setting the setting to overwrite
+ * @param minimum the smallest valid value
+ * @returns the description of the setting
+ */
+template <typename T>
+static PolicySetting makeSetting(const char* option, const char* variable, T& setting, T minimum)
+{
+  return {option, variable, [&setting, minimum](const std::string& name, const std::string& value) {
+            parseSetting(name, value, setting, minimum);
+          }};
+}
+
+/**
+ * Set up the collection policy from the environment variables SCHEME_GC_GROWTH,
+ * SCHEME_GC_MIN_HEAP, SCHEME_GC_NURSERY, SCHEME_GC_SLICE, SCHEME_GC_THREADS, SCHEME_GC_COMPACT,
+ * SCHEME_GC_LAZY_SWEEP, SCHEME_GC_SHRINK and SCHEME_GC_STATS and the command line options
+ * --gc-growth=<factor>, --gc-min-heap=<bytes>, --gc-nursery=<bytes>, --gc-slice=<microseconds>,
+ * --gc-threads=<n>, --gc-compact, --gc-lazy-sweep=<0|1>, --gc-shrink=<fraction> and
+ * --gc-stats=json, command line options take precedence.
+ * Recognized options are removed from the argument list.
+ * @param argc the number of command line arguments, updated if options were removed
+ * @param argv the command line arguments
+ */
+void configureGarbageCollection(int& argc, char** argv)
+{
+  const std::vector<PolicySetting> settings{
+      makeSetting("--gc-growth", "SCHEME_GC_GROWTH", policy.growthFactor, 1.0),
+      makeSetting("--gc-min-heap", "SCHEME_GC_MIN_HEAP", policy.minHeapSize, std::size_t{0}),
+      makeSetting("--gc-nursery", "SCHEME_GC_NURSERY", policy.nurserySize, std::size_t{0}),
+      makeSetting("--gc-slice", "SCHEME_GC_SLICE", policy.sliceBudget, 0L),
+      makeSetting("--gc-threads", "SCHEME_GC_THREADS", policy.markingThreads, 1),
+      makeSetting("--gc-compact", "SCHEME_GC_COMPACT", policy.compactConsCells, false),
+      makeSetting("--gc-lazy-sweep", "SCHEME_GC_LAZY_SWEEP", policy.lazySweep, false),
+      makeSetting("--gc-shrink", "SCHEME_GC_SHRINK", policy.shrinkWatermark, 0.0),
+      {"--gc-stats", "SCHEME_GC_STATS", configureStatisticsReport},
+  };
+  for (const PolicySetting& setting : settings) {
+    if (const char* value{std::getenv(setting.variable)}) {
+      setting.parse(setting.variable, value);
+    }
+  }
+  int nKept{1};
+  for (int i{1}; i < argc; i++) {
+    std::string argument{argv[i]};
+    auto setting{std::find_if(settings.begin(), settings.end(), [&argument](auto& setting) {
+      return argument.rfind(setting.option + '=', 0) == 0;
+    })};
+    if (setting != settings.end()) {
+      setting->parse(setting->option, argument.substr(setting->option.size() + 1));
+    }
+    else if (argument == "--gc-compact") {
+      policy.compactConsCells = true;
+    }
+    else {
+      argv[nKept++] = argv[i];
+    }
+  }
+  argc = nKept;
+  collectionThreshold = policy.minHeapSize;
+  DLOG_IF_F(INFO,
+            LOG_GARBAGE_COLLECTION,
+            "collecting at a growth factor of %f, minimum heap size %d bytes, nursery %d bytes, "
+            "slices of %ld microseconds, %d marking threads, compaction %s, lazy sweep %s, "
+            "shrinking below %f",
+            policy.growthFactor,
+            static_cast<int>(policy.minHeapSize),
+            static_cast<int>(policy.nurserySize),
+            policy.sliceBudget,
+            policy.markingThreads,
+            policy.compactConsCells ? "on" : "off",
+            policy.lazySweep ? "on" : "off",
+            policy.shrinkWatermark);
 }
 
-}  // namespace scm
\ No newline at end of file
+}  // namespace scm
@@ -1,29 +1,124 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <stack>
 #include <vector>
+#include "heap.hpp"
 // #include "environment.hpp"
 
 namespace scm {
 class Environment;
+// defined in scheme.hpp, declared here so the header can hold it
+enum ObjectTypeTag : int;
 
 /**
- * The base class of every object that's supposed to be visible to the garbage collector.
+ * The base class of every object that's supposed to be visible to the garbage collector, scheme
+ * objects as well as environments. There's no vtable, the whole header fits in a single word.
+ * Subclasses are identified by their tag, which is never zero so that live cells can be told apart
+ * from free ones.
  */
 class Collectable {
  public:
-  // a unique identifier of the object
-  long id;
+  // the type of the object, used to find its layout
+  ObjectTypeTag tag;
   // essential objects are never collected
   bool essential;
-  // determines whether the object should be spared during the next sweeping cycle
-  bool marked;
+  // survived at least one collection, see collectYoungGeneration
+  // the mark bit lives in the chunk instead, see heap::isMarked
+  bool old;
+  // an old collectable in the remembered set, see writeBarrier
+  bool remembered;
 
-  Collectable();
-  virtual ~Collectable();
+  Collectable(ObjectTypeTag tag);
+
+  // collectables live in the chunks of our own heap instead of the global free store
+  static void* operator new(std::size_t size);
+  static void operator delete(void* ptr, std::size_t size);
+};
+
+/**
+ * The state of an incremental collection, see performCollectionSlice.
+ */
+enum CollectionPhase {
+  PHASE_IDLE,
+  // collectables are marked a slice at a time, the mutator runs in between
+  PHASE_MARKING,
+  // marking is done, the heap is swept a slice at a time
+  PHASE_SWEEPING,
+};
+
+extern CollectionPhase collectionPhase;
+
+// pauses are counted per power of ten microseconds, from below 10us up to 100ms and longer
+constexpr int N_PAUSE_BUCKETS{6};
+
+/**
+ * What the collector did since the interpreter started. A pause is any collection work done at a
+ * safepoint of the trampoline, be it a whole collection or a single slice.
+ */
+struct CollectionStatistics {
+  long nFullCollections;
+  long nYoungCollections;
+  long nSlices;
+  long nPauses;
+  double totalPauseMicroseconds;
+  double maxPauseMicroseconds;
+  // the number of pauses shorter than 10us, 100us, 1ms, 10ms, 100ms and the rest
+  std::array<long, N_PAUSE_BUCKETS> pauseHistogram;
 };
 
-void markAndSweep(Environment& env);
+/**
+ * The number of objects of a single type on the heap and the bytes their cells take up.
+ */
+struct CensusEntry {
+  long nObjects;
+  std::size_t nBytes;
+};
+
+void collectGarbage();
+void collectYoungGeneration();
+void performCollectionSlice();
+void collectGarbageIfDue();
+int setMarkingThreads(int nThreads);
+bool setConsCompaction(bool enabled);
+void rememberCollectable(Collectable* holder);
+void shadeCollectable(Collectable* obj);
+void addRootEnvironment(Environment* env);
+void removeRootEnvironment(Environment* env);
+void configureGarbageCollection(int& argc, char** argv);
+const CollectionStatistics& getCollectionStatistics();
+std::vector<CensusEntry> takeHeapCensus();
+void writeStatisticsJson(std::ostream& stream);
 void mark(Environment& env);
+void forwardReferences(Environment& env);
+
+/**
+ * The write barrier of the collector, call it whenever a reference is stored into an object or
+ * environment after it was created.
+ * If an old collectable is made to refer to a young one, it's remembered, otherwise the young one
+ * would look unreachable to the next collection of the young generation.
+ * While an incremental collection is marking, a reference stored into an already marked
+ * collectable is marked as well, otherwise it would be missed if nothing else refers to it.
+ * @param holder the object or environment that's written to
+ * @param value the stored reference, may be a fixnum, an immediate or NULL
+ */
+inline void writeBarrier(Collectable* holder, Collectable* value)
+{
+  // fixnums and immediates have one of the two lowest bits set, they don't live on the heap
+  if (value == NULL || (reinterpret_cast<std::uintptr_t>(value) & 0b11) != 0) {
+    return;
+  }
+  if (collectionPhase == PHASE_IDLE) {
+    if (holder->old && !value->old) {
+      rememberCollectable(holder);
+    }
+  }
+  else if (collectionPhase == PHASE_MARKING && heap::isMarked(holder) && !heap::isMarked(value)) {
+    shadeCollectable(value);
+  }
+}
 
 }  // namespace scm
@@ -0,0 +1,370 @@
+#include "heap.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <loguru.hpp>
+#include <new>
+#include "scheme.hpp"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#elif defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#endif
+
+namespace scm {
+namespace heap {
+
+/**
+ * The allocation state of a single size class.
+ * New cells are bumped off the current chunk, freed cells are reused once it's exhausted.
+ */
+struct SizeClass {
+  Chunk* current;
+  FreeCell* freeList;
+};
+
+// all chunks ever requested, in the order they were created
+static std::vector<Chunk*> chunks;
+// one entry per multiple of SIZE_CLASS_GRANULE up to MAX_SMALL_SIZE
+static SizeClass sizeClasses[N_SIZE_CLASSES]{};
+// chunks for large objects, each holds exactly one cell
+static std::vector<Chunk*> largeChunks;
+// keep track of how many bytes are currently handed out
+static std::size_t allocatedBytes{0};
+// and how many were handed out ever since the start
+static std::size_t totalAllocatedBytes{0};
+// the memory of all chunks together, see getMappedBytes
+static std::size_t mappedBytes{0};
+// called before a new chunk is requested, see setSweeper
+static bool (*sweeper)(){NULL};
+
+/**
+ * Round a requested size up to the cell size of its size class.
+ * @param size the requested size in bytes
+ * @returns the cell size
+ */
+static std::size_t roundToGranule(std::size_t size)
+{
+  // every cell needs to be able to hold a free list entry
+  size = std::max(size, sizeof(FreeCell));
+  return (size + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE * SIZE_CLASS_GRANULE;
+}
+
+/**
+ * Map a block of memory aligned to CHUNK_SIZE. On unix systems it's mapped directly so that it
+ * can be handed back to the operating system once the chunk is released, a block freed to the C
+ * heap usually stays part of the process.
+ * @param size the size of the block, a multiple of CHUNK_SIZE
+ * @returns a pointer to the block
+ */
+static char* mapMemory(std::size_t size)
+{
+#if defined(__unix__) || defined(__APPLE__)
+  // map an extra chunk so an aligned block fits in, then unmap what's left over at both ends
+  std::size_t mappedSize{size + CHUNK_SIZE};
+  void* mapped{
+      mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if (mapped == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  std::uintptr_t start{reinterpret_cast<std::uintptr_t>(mapped)};
+  std::uintptr_t aligned{(start + CHUNK_SIZE - 1) & ~(CHUNK_SIZE - 1)};
+  if (aligned > start) {
+    munmap(mapped, aligned - start);
+  }
+  if (start + mappedSize > aligned + size) {
+    munmap(reinterpret_cast<void*>(aligned + size), start + mappedSize - aligned - size);
+  }
+  return reinterpret_cast<char*>(aligned);
+#else
+#if defined(_WIN32) || defined(_WIN64)
+  // msvc doesn't provide std::aligned_alloc
+  char* memory{static_cast<char*>(_aligned_malloc(size, CHUNK_SIZE))};
+#else
+  char* memory{static_cast<char*>(std::aligned_alloc(CHUNK_SIZE, size))};
+#endif
+  if (memory == NULL) {
+    throw std::bad_alloc();
+  }
+  return memory;
+#endif
+}
+
+/**
+ * Hand a block of memory obtained by mapMemory back to the operating system.
+ * @param memory the start of the block
+ * @param size the size it was mapped with
+ */
+static void unmapMemory(char* memory, std::size_t size)
+{
+#if defined(__unix__) || defined(__APPLE__)
+  munmap(memory, size);
+#elif defined(_WIN32) || defined(_WIN64)
+  (void)size;
+  _aligned_free(memory);
+#else
+  (void)size;
+  std::free(memory);
+#endif
+}
+
+/**
+ * Request a new chunk from the operating system. Small cells fill a chunk of CHUNK_SIZE bytes,
+ * a large object gets a chunk of its own that's rounded up to a multiple of CHUNK_SIZE.
+ * @param cellSize the size of the cells the chunk will hold
+ * @returns a pointer to the new chunk
+ */
+static Chunk* newChunk(std::size_t cellSize)
+{
+  bool isLarge{cellSize > MAX_SMALL_SIZE};
+  std::size_t capacity{isLarge ? cellSize
+                               : (CHUNK_SIZE - CHUNK_HEADER_SIZE) / cellSize * cellSize};
+  std::size_t size{(CHUNK_HEADER_SIZE + capacity + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE};
+  char* memory{mapMemory(size)};
+  mappedBytes += size;
+  std::size_t nMarkWords{(capacity / SIZE_CLASS_GRANULE + 63) / 64};
+  char* begin{memory + CHUNK_HEADER_SIZE};
+  Chunk* chunk{new Chunk{cellSize,
+                         begin,
+                         begin,
+                         begin + capacity,
+                         memory,
+                         size,
+                         std::make_unique<std::atomic<std::uint64_t>[]>(nMarkWords)}};
+  *reinterpret_cast<Chunk**>(memory) = chunk;
+  chunks.push_back(chunk);
+  DLOG_IF_F(INFO,
+            LOG_MEMORY,
+            "new chunk for cells of %d bytes (%d chunks)",
+            static_cast<int>(cellSize),
+            static_cast<int>(chunks.size()));
+  return chunk;
+}
+
+/**
+ * Allocate a large object, which lives in a chunk of its own.
+ * @param cellSize the rounded size of the object
+ * @returns a pointer to the uninitialized cell
+ */
+static void* allocateLarge(std::size_t cellSize)
+{
+  // reuse a large chunk that was freed before
+  for (Chunk* chunk : largeChunks) {
+    if (!isLiveCell(chunk->begin) && chunk->cellSize >= cellSize) {
+      return chunk->begin;
+    }
+  }
+  Chunk* chunk{newChunk(cellSize)};
+  largeChunks.push_back(chunk);
+  chunk->bump = chunk->end;
+  return chunk->begin;
+}
+
+/**
+ * Allocate a cell of at least the given size. The hot path is a pointer increment within the
+ * current chunk of the size class. Free cells are only reused once the chunk is exhausted.
+ * @param size the requested size in bytes
+ * @returns a pointer to the uninitialized cell
+ */
+void* allocate(std::size_t size)
+{
+  std::size_t cellSize{roundToGranule(size)};
+  allocatedBytes += cellSize;
+  totalAllocatedBytes += cellSize;
+  if (cellSize > MAX_SMALL_SIZE) {
+    return allocateLarge(cellSize);
+  }
+  SizeClass& sizeClass{sizeClasses[cellSize / SIZE_CLASS_GRANULE - 1]};
+
+  // hot path: bump the pointer of the current chunk
+  Chunk* chunk{sizeClass.current};
+  if (chunk != NULL && chunk->bump + cellSize <= chunk->end) {
+    void* cell{chunk->bump};
+    chunk->bump += cellSize;
+    return cell;
+  }
+  // reuse a cell that was freed before, let a pending sweep free some first
+  while (sizeClass.freeList == NULL && sweeper != NULL && sweeper()) {
+  }
+  if (sizeClass.freeList != NULL) {
+    FreeCell* cell{sizeClass.freeList};
+    sizeClass.freeList = cell->next;
+    return cell;
+  }
+  // start a new chunk for this size class
+  chunk = newChunk(cellSize);
+  sizeClass.current = chunk;
+  chunk->bump += cellSize;
+  return chunk->begin;
+}
+
+/**
+ * Allocate a small cell without reusing freed cells, consecutive calls for the same size class
+ * return adjacent cells until the current chunk is exhausted. Used to lay out objects in the
+ * order in which they're going to be accessed.
+ * @param size the requested size in bytes, at most MAX_SMALL_SIZE
+ * @returns a pointer to the uninitialized cell
+ */
+void* allocateContiguous(std::size_t size)
+{
+  std::size_t cellSize{roundToGranule(size)};
+  allocatedBytes += cellSize;
+  SizeClass& sizeClass{sizeClasses[cellSize / SIZE_CLASS_GRANULE - 1]};
+  Chunk* chunk{sizeClass.current};
+  if (chunk == NULL || chunk->bump + cellSize > chunk->end) {
+    chunk = newChunk(cellSize);
+    sizeClass.current = chunk;
+  }
+  void* cell{chunk->bump};
+  chunk->bump += cellSize;
+  return cell;
+}
+
+/**
+ * Return a cell to the free list of its size class.
+ * @param cell the cell to be freed, the object in it must already be destroyed
+ * @param size the size that was originally requested for the cell
+ */
+void release(void* cell, std::size_t size)
+{
+  std::size_t cellSize{roundToGranule(size)};
+  allocatedBytes -= cellSize;
+  FreeCell* freeCell{static_cast<FreeCell*>(cell)};
+  freeCell->freeMarker = 0;
+  if (cellSize > MAX_SMALL_SIZE) {
+    freeCell->next = NULL;
+    return;
+  }
+  SizeClass& sizeClass{sizeClasses[cellSize / SIZE_CLASS_GRANULE - 1]};
+  freeCell->next = sizeClass.freeList;
+  sizeClass.freeList = freeCell;
+}
+
+/**
+ * Get all chunks of the heap, used to enumerate objects.
+ * @returns the chunks in order of creation
+ */
+const std::vector<Chunk*>& getChunks()
+{
+  return chunks;
+}
+
+/**
+ * Does the chunk hold at least one object?
+ * @param chunk the chunk to check
+ * @returns false if all of its cells are free
+ */
+static bool hasLiveCell(const Chunk* chunk)
+{
+  for (const char* cell{chunk->begin}; cell < chunk->bump; cell += chunk->cellSize) {
+    if (isLiveCell(cell)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Return chunks without a single object to the operating system, their cells are taken off the
+ * free lists first. The current chunk of every size class is kept.
+ * Must not be called while the chunks are walked.
+ * @returns the number of released chunks
+ */
+std::size_t releaseEmptyChunks()
+{
+  std::vector<Chunk*> kept;
+  std::vector<Chunk*> released;
+  for (Chunk* chunk : chunks) {
+    bool isSmall{chunk->cellSize <= MAX_SMALL_SIZE};
+    if ((isSmall && chunk == sizeClasses[chunk->cellSize / SIZE_CLASS_GRANULE - 1].current) ||
+        hasLiveCell(chunk)) {
+      kept.push_back(chunk);
+    }
+    else {
+      released.push_back(chunk);
+    }
+  }
+  if (released.empty()) {
+    return 0;
+  }
+  std::sort(released.begin(), released.end(), [](const Chunk* a, const Chunk* b) {
+    return a->begin < b->begin;
+  });
+  auto isReleased = [&released](const FreeCell* cell) {
+    const char* cellAddress{reinterpret_cast<const char*>(cell)};
+    auto after{std::upper_bound(
+        released.begin(), released.end(), cellAddress, [](const char* address, const Chunk* chunk) {
+          return address < chunk->begin;
+        })};
+    return after != released.begin() && cellAddress < (*(after - 1))->end;
+  };
+  for (SizeClass& sizeClass : sizeClasses) {
+    FreeCell** link{&sizeClass.freeList};
+    while (*link != NULL) {
+      if (isReleased(*link)) {
+        *link = (*link)->next;
+      }
+      else {
+        link = &(*link)->next;
+      }
+    }
+  }
+  largeChunks.erase(std::remove_if(largeChunks.begin(),
+                                   largeChunks.end(),
+                                   [](const Chunk* chunk) { return !hasLiveCell(chunk); }),
+                    largeChunks.end());
+  for (Chunk* chunk : released) {
+    unmapMemory(chunk->memory, chunk->memorySize);
+    mappedBytes -= chunk->memorySize;
+    delete chunk;
+  }
+  chunks = std::move(kept);
+  DLOG_IF_F(INFO,
+            LOG_MEMORY,
+            "released %d empty chunks (%d chunks)",
+            static_cast<int>(released.size()),
+            static_cast<int>(chunks.size()));
+  return released.size();
+}
+
+/**
+ * Get the number of bytes currently handed out to objects, including rounding.
+ * @returns the allocated size in bytes
+ */
+std::size_t getAllocatedBytes()
+{
+  return allocatedBytes;
+}
+
+/**
+ * Get the number of bytes handed out to objects since the start, freed ones included. Cells the
+ * collector copies objects into aren't counted.
+ * @returns the allocated size in bytes
+ */
+std::size_t getTotalAllocatedBytes()
+{
+  return totalAllocatedBytes;
+}
+
+/**
+ * Get the number of bytes requested from the operating system for chunks, whether their cells
+ * are in use or not.
+ * @returns the size of all chunks in bytes
+ */
+std::size_t getMappedBytes()
+{
+  return mappedBytes;
+}
+
+/**
+ * Install the function that's called when a size class has run out of cells, before a new chunk
+ * is requested. It lets a collection that hasn't finished sweeping free cells on demand.
+ * The sweeper may release cells but must not release chunks.
+ * @param callback returns false once there's nothing left to sweep, NULL to remove the sweeper
+ */
+void setSweeper(bool (*callback)())
+{
+  sweeper = callback;
+}
+
+}  // namespace heap
+}  // namespace scm
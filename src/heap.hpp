@@ -0,0 +1,177 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace scm {
+class Collectable;
+
+namespace heap {
+
+// every chunk requested from the operating system is at least this big and aligned to this size
+constexpr std::size_t CHUNK_SIZE{256 * 1024};
+// the start of every chunk holds a pointer to its Chunk, the cells follow
+constexpr std::size_t CHUNK_HEADER_SIZE{16};
+// cell sizes are rounded up to a multiple of this
+constexpr std::size_t SIZE_CLASS_GRANULE{8};
+// objects larger than this get a chunk of their own
+constexpr std::size_t MAX_SMALL_SIZE{512};
+constexpr std::size_t N_SIZE_CLASSES{MAX_SMALL_SIZE / SIZE_CLASS_GRANULE};
+
+/**
+ * A free cell is threaded into the free list of its size class. The first word of every live
+ * object is its header, which is never zero as it contains the tag, so a zero in the first word
+ * marks a cell as free when walking a chunk.
+ */
+struct FreeCell {
+  std::uintptr_t freeMarker;
+  FreeCell* next;
+};
+
+/**
+ * A contiguous block of memory holding cells of a single size.
+ * Cells are handed out by incrementing `bump` until `end` is reached.
+ * The mark bits of the cells are kept in a separate bitmap, so a collection never writes to the
+ * pages of surviving objects. Pages shared with a forked process therefore stay shared.
+ */
+struct Chunk {
+  std::size_t cellSize;
+  char* begin;
+  char* bump;
+  char* end;
+  // the block of memory requested from the operating system
+  char* memory;
+  std::size_t memorySize;
+  // one bit per SIZE_CLASS_GRANULE bytes of cells, atomic for marking in parallel
+  std::unique_ptr<std::atomic<std::uint64_t>[]> markBits;
+};
+
+/**
+ * Find the chunk a cell belongs to. Chunks are aligned to CHUNK_SIZE and start with a pointer to
+ * their Chunk, a large object always starts within the first CHUNK_SIZE bytes of its chunk.
+ * @param cell the address of the cell
+ * @returns the chunk holding the cell
+ */
+inline Chunk* getChunkOf(const void* cell)
+{
+  std::uintptr_t memory{reinterpret_cast<std::uintptr_t>(cell) & ~(CHUNK_SIZE - 1)};
+  return *reinterpret_cast<Chunk* const*>(memory);
+}
+
+/**
+ * The location of the mark bit of a cell.
+ */
+struct MarkBit {
+  std::atomic<std::uint64_t>* word;
+  std::uint64_t mask;
+};
+
+/**
+ * Find the mark bit of a cell in the bitmap of its chunk.
+ * @param cell the address of the cell
+ * @returns the word holding the bit and its mask
+ */
+inline MarkBit getMarkBit(const void* cell)
+{
+  Chunk* chunk{getChunkOf(cell)};
+  std::size_t index{static_cast<std::size_t>(static_cast<const char*>(cell) - chunk->begin) /
+                    SIZE_CLASS_GRANULE};
+  return {&chunk->markBits[index / 64], std::uint64_t{1} << (index % 64)};
+}
+
+/**
+ * Is the cell marked?
+ * @param cell the address of the cell
+ * @returns whether its mark bit is set
+ */
+inline bool isMarked(const void* cell)
+{
+  MarkBit bit{getMarkBit(cell)};
+  return (bit.word->load(std::memory_order_relaxed) & bit.mask) != 0;
+}
+
+/**
+ * Set or clear the mark bit of a cell. Must not be used while marking in parallel.
+ * @param cell the address of the cell
+ * @param marked the new value of the bit
+ */
+inline void setMarked(const void* cell, bool marked)
+{
+  MarkBit bit{getMarkBit(cell)};
+  std::uint64_t word{bit.word->load(std::memory_order_relaxed)};
+  bit.word->store(marked ? word | bit.mask : word & ~bit.mask, std::memory_order_relaxed);
+}
+
+/**
+ * Set the mark bit of a cell, even if other threads try to mark it at the same time.
+ * @param cell the address of the cell
+ * @returns false if the cell was already marked
+ */
+inline bool markAtomically(const void* cell)
+{
+  MarkBit bit{getMarkBit(cell)};
+  return (bit.word->fetch_or(bit.mask, std::memory_order_relaxed) & bit.mask) == 0;
+}
+
+void* allocate(std::size_t size);
+void* allocateContiguous(std::size_t size);
+void release(void* cell, std::size_t size);
+const std::vector<Chunk*>& getChunks();
+std::size_t releaseEmptyChunks();
+std::size_t getAllocatedBytes();
+std::size_t getTotalAllocatedBytes();
+std::size_t getMappedBytes();
+void setSweeper(bool (*callback)());
+
+/**
+ * Is the cell at the given address currently holding an object?
+ * @param cell the address of the cell
+ * @returns false if the cell is on a free list
+ */
+inline bool isLiveCell(const char* cell)
+{
+  return *reinterpret_cast<const std::uintptr_t*>(cell) != 0;
+}
+
+/**
+ * Call a function on every live object of the heap by walking all chunks in address order.
+ * @tparam FUNC a callable taking a Collectable*
+ * @param callback the function to call for every object
+ */
+template <typename FUNC>
+void forEachObject(FUNC callback)
+{
+  for (Chunk* chunk : getChunks()) {
+    for (char* cell{chunk->begin}; cell < chunk->bump; cell += chunk->cellSize) {
+      if (isLiveCell(cell)) {
+        callback(reinterpret_cast<Collectable*>(cell));
+      }
+    }
+  }
+}
+
+/**
+ * Call a function on every live object of the heap, walking each chunk from its last cell down to
+ * its first. Cells freed by the callback are pushed onto the front of their free list, walking
+ * backwards therefore leaves them in ascending address order and allocation after a collection
+ * moves through memory in the same direction as the bump pointer.
+ * @tparam FUNC a callable taking a Collectable*
+ * @param callback the function to call for every object
+ */
+template <typename FUNC>
+void forEachObjectBackwards(FUNC callback)
+{
+  for (Chunk* chunk : getChunks()) {
+    for (char* cell{chunk->bump}; cell > chunk->begin;) {
+      cell -= chunk->cellSize;
+      if (isLiveCell(cell)) {
+        callback(reinterpret_cast<Collectable*>(cell));
+      }
+    }
+  }
+}
+
+}  // namespace heap
+}  // namespace scm
@@ -2,14 +2,17 @@
 #include <fstream>
 #include <iostream>
 #include <loguru.hpp>
+#include "benchmark.hpp"
 #include "environment.hpp"
 #include "evaluate.hpp"
+#include "garbage_collection.hpp"
 #include "memory.hpp"
 #include "parse.hpp"
 #include "repl.hpp"
 #include "scheme.hpp"
 #include "setup.hpp"
 #include "test.hpp"
+#include "vm.hpp"
 
 int main(int argc, char** argv)
 {
@@ -20,10 +23,15 @@ int main(int argc, char** argv)
   loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
 #endif
   loguru::init(argc, argv);
+  scm::configureGarbageCollection(argc, argv);
+  scm::vm::configureEvaluation(argc, argv);
 
   // setup initial starting point
   scm::initializeSingletons();
-  scm::Environment topLevelEnv{};
+  // the top level environment is a root of the garbage collector and never freed
+  scm::Environment& topLevelEnv{*scm::newEnvironment()};
+  topLevelEnv.essential = true;
+  scm::addRootEnvironment(&topLevelEnv);
   scm::setupEnvironment(topLevelEnv);
 
   // run function setup for those written in scheme
@@ -45,6 +53,12 @@ int main(int argc, char** argv)
   // run unit tests, will crash if any tests fail!
   scm::runTests(topLevelEnv);
 
+  // measure the performance of the interpreter instead of running it
+  if (argc == 2 && std::string(argv[1]) == "--benchmark") {
+    scm::runBenchmarks(topLevelEnv);
+    return 0;
+  }
+
   // define input stream either as cin or from file
   std::istream* streamPtr;
   std::ifstream inputStream;
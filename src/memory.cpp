@@ -1,5 +1,7 @@
 #include "memory.hpp"
 #include <loguru.hpp>
+#include <unordered_map>
+#include "environment.hpp"
 #include "garbage_collection.hpp"
 #include "scheme.hpp"
 
@@ -13,6 +15,9 @@ Object* SCM_EOF;
 Object* SCM_TRUE;
 Object* SCM_FALSE;
 
+// all symbols ever created, indexed by name
+static std::unordered_map<std::string, Object*> SymbolTable;
+
 /**
  * Sets up all singleton objects
  */
@@ -26,28 +31,25 @@ void initializeSingletons()
 }
 
 /**
- * Create a new Singleton of the specified type
+ * Create a new Singleton of the specified type.
+ * Singletons are immediate values, so there's nothing to allocate or to collect.
  * @param type the type of the singleton
- * @returns a pointer to the allocated object
+ * @returns the tagged value word of the singleton
  */
 Object* newSingleton(ObjectTypeTag type)
 {
-  Object* obj{new Object(type)};
-  // singletons should never be deleted!
-  obj->essential = true;
-  return obj;
+  return makeImmediate(type);
 }
 
 /**
- * Create a new scheme integer
+ * Create a new scheme integer.
+ * Integers are stored as fixnums directly in the value word, no allocation takes place.
  * @param value the value of the integer
- * @returns a pointer to the allocated object
+ * @returns the tagged value word of the integer
  */
 Object* newInteger(int value)
 {
-  Object* obj{new Object(TAG_INT)};
-  obj->value = value;
-  return obj;
+  return makeFixnum(value);
 }
 
 /**
@@ -57,9 +59,7 @@ Object* newInteger(int value)
  */
 Object* newFloat(double value)
 {
-  Object* obj{new Object(TAG_FLOAT)};
-  obj->value = value;
-  return obj;
+  return new FloatObject(value);
 }
 
 /**
@@ -69,20 +69,25 @@ Object* newFloat(double value)
  */
 Object* newString(std::string value)
 {
-  Object* obj{new Object(TAG_STRING)};
-  obj->value = value;
-  return obj;
+  return new StringObject(TAG_STRING, value);
 }
 
 /**
- * Create a new scheme symbol
+ * Get the scheme symbol with the given name. Symbols are interned: every distinct name is
+ * allocated exactly once, so symbols can be compared by pointer.
  * @param value the name of the symbol
- * @returns a pointer to the allocated object
+ * @returns a pointer to the interned symbol object
  */
 Object* newSymbol(std::string value)
 {
-  Object* obj{new Object(TAG_SYMBOL)};
-  obj->value = value;
+  auto found{SymbolTable.find(value)};
+  if (found != SymbolTable.end()) {
+    return found->second;
+  }
+  Object* obj{new StringObject(TAG_SYMBOL, value)};
+  // the symbol table keeps all symbols alive
+  obj->essential = true;
+  SymbolTable.emplace(std::move(value), obj);
   return obj;
 }
 
@@ -94,25 +99,19 @@ Object* newSymbol(std::string value)
  */
 Object* newCons(Object* car, Object* cdr)
 {
-  Object* obj{new Object(TAG_CONS)};
-  obj->value = ConsValue{car, cdr};
-  return obj;
+  return new ConsObject(car, cdr);
 }
 
 /**
  * Create a new scheme builtin function object
- * @param name the name of the function
- * @param numArgs the amount of arguments required by the function
- * @param funcTag the tag of the function for identification purposes
- * @param helpText the text diplayed when requested help for
- * @see defineNewBuiltinFunction
+ * @param descriptor the name, arity, code and help text of the function
+ * @see setupEnvironment
  * @see helpSyntax
  * @returns a pointer to the allocated object
  */
-Object* newBuiltinFunction(std::string name, int numArgs, FunctionTag funcTag, std::string helpText)
+Object* newBuiltinFunction(const BuiltinDescriptor& descriptor)
 {
-  Object* obj{new Object(TAG_FUNC_BUILTIN)};
-  obj->value = FuncValue{"primitive:" + name, numArgs, funcTag, helpText};
+  Object* obj{new FuncObject(TAG_FUNC_BUILTIN, &descriptor)};
   // builtin functions should never be deleted!
   obj->essential = true;
   return obj;
@@ -120,18 +119,14 @@ Object* newBuiltinFunction(std::string name, int numArgs, FunctionTag funcTag, s
 
 /**
  * Create a new scheme builtin syntax object
- * @param name the name of the syntax
- * @param numArgs the amount of arguments required by the syntax
- * @param funcTag the tag of the syntax for identification purposes
- * @param helpText the text diplayed when requested help for
- * @see defineNewSyntax
+ * @param descriptor the name, arity, code and help text of the syntax
+ * @see setupEnvironment
  * @see helpSyntax
  * @returns a pointer to the allocated object
  */
-Object* newSyntax(std::string name, int numArgs, FunctionTag funcTag, std::string helpText)
+Object* newSyntax(const BuiltinDescriptor& descriptor)
 {
-  Object* obj{new Object(TAG_SYNTAX)};
-  obj->value = FuncValue{"syntax:" + name, numArgs, funcTag, helpText};
+  Object* obj{new FuncObject(TAG_SYNTAX, &descriptor)};
   // builtin syntax should never be deleted!
   obj->essential = true;
   return obj;
@@ -141,13 +136,130 @@ Object* newSyntax(std::string name, int numArgs, FunctionTag funcTag, std::strin
  * Create a new user defined function object
  * @param argList a cons with all arguments required by the function
  * @param bodyList a cons of one or more expressions to be evaluated
- * @param homeEnv the home environment of the function, arguments and variables are defined in here
+ * @param slotNames a list of the names of all local variables, starting with the arguments
+ * @param homeEnv the home environment of the function, the parent of the frames of its calls
+ * @param code the compiled body, NULL to compile it on the first call by the virtual machine
  * @returns a pointer to the allocated object
  */
-Object* newUserFunction(Object* argList, Object* bodyList, Environment& homeEnv)
+Object* newUserFunction(Object* argList,
+                        Object* bodyList,
+                        Object* slotNames,
+                        Environment& homeEnv,
+                        Object* code)
 {
-  Object* obj{new Object(TAG_FUNC_USER)};
-  obj->value = UserFuncValue{argList, bodyList, &homeEnv};
-  return obj;
+  int frameSize{0};
+  for (Object* name{slotNames}; name != SCM_NIL; name = getCdr(name)) {
+    frameSize++;
+  }
+  return new UserFuncObject({argList, bodyList, &homeEnv, slotNames, frameSize, code});
+}
+
+/**
+ * Create a new, empty environment on the heap.
+ * @param parent the enclosing environment, NULL for a top level environment
+ * @returns a pointer to the allocated environment
+ */
+Environment* newEnvironment(Environment* parent)
+{
+  return new Environment(parent);
+}
+
+/**
+ * Create the frame of a function call on the heap.
+ * @param parent the environment the function was created in
+ * @param slotNames the names of the local variables of the function
+ * @param frameSize the number of local variables
+ * @returns a pointer to the allocated environment
+ */
+Environment* newEnvironment(Environment* parent, Object* slotNames, int frameSize)
+{
+  return new Environment(parent, slotNames, frameSize);
+}
+
+/**
+ * Create a new reference to a local variable.
+ * @param symbol the name of the variable
+ * @param depth the number of frames between the reference and the frame of the variable
+ * @param slot the index of the variable in its frame
+ * @returns a pointer to the allocated object
+ */
+Object* newLocalRef(Object* symbol, int depth, int slot)
+{
+  return new LocalRefObject({symbol, depth, slot});
+}
+
+/**
+ * Create a new, still unbound value cell for a top level variable.
+ * @param symbol the name of the variable
+ * @returns a pointer to the allocated object
+ */
+Object* newGlobalCell(Object* symbol)
+{
+  return new GlobalCellObject({symbol, NULL});
+}
+
+/**
+ * Create a new piece of compiled code.
+ * @param value the instructions and constants, see compile.cpp
+ * @returns a pointer to the allocated object
+ */
+Object* newBytecode(BytecodeValue value)
+{
+  return new BytecodeObject(std::move(value));
+}
+
+/**
+ * Create a new analyzed syntax form.
+ * @param syntax the syntax of the form
+ * @param first the first part of the form
+ * @param second the second part of the form, if it has one
+ * @param third the third part of the form, if it has one
+ * @returns a pointer to the allocated object
+ */
+Object* newSpecialForm(FunctionTag syntax, Object* first, Object* second, Object* third)
+{
+  return new SpecialFormObject({syntax, first, second, third});
+}
+
+/**
+ * Destroy a heap object and return its memory to the heap. As objects don't have a vtable,
+ * the layout to destroy is chosen by the tag of the object.
+ * @param obj the object to destroy, must not be a fixnum or an immediate
+ */
+void destroyObject(Object* obj)
+{
+  switch (getTag(obj)) {
+    case TAG_FLOAT:
+      delete static_cast<FloatObject*>(obj);
+      break;
+    case TAG_STRING:
+    case TAG_SYMBOL:
+      delete static_cast<StringObject*>(obj);
+      break;
+    case TAG_CONS:
+      delete static_cast<ConsObject*>(obj);
+      break;
+    case TAG_FUNC_BUILTIN:
+    case TAG_SYNTAX:
+      delete static_cast<FuncObject*>(obj);
+      break;
+    case TAG_FUNC_USER:
+      delete static_cast<UserFuncObject*>(obj);
+      break;
+    case TAG_LOCAL_REF:
+      delete static_cast<LocalRefObject*>(obj);
+      break;
+    case TAG_GLOBAL_CELL:
+      delete static_cast<GlobalCellObject*>(obj);
+      break;
+    case TAG_BYTECODE:
+      delete static_cast<BytecodeObject*>(obj);
+      break;
+    case TAG_SPECIAL_FORM:
+      delete static_cast<SpecialFormObject*>(obj);
+      break;
+    default:
+      schemeThrow("can't destroy object with tag " + tagToString(getTag(obj)));
+  }
 }
 }  // namespace scm
@@ -8,18 +8,25 @@ Object* newSingleton(ObjectTypeTag tag);
 Object* newInteger(int value);
 Object* newFloat(double value);
 Object* newString(std::string value);
-Object* newEnv();
+Environment* newEnvironment(Environment* parent = NULL);
+Environment* newEnvironment(Environment* parent, Object* slotNames, int frameSize);
 Object* newSymbol(std::string value);
 Object* newCons(Object* car, Object* cdr);
-Object* newSyntax(std::string name,
-                  int numArgs,
-                  FunctionTag funcTag,
-                  std::string helpText = "no help available");
-Object* newBuiltinFunction(std::string name,
-                           int numArgs,
-                           FunctionTag funcTag,
-                           std::string helpText = "no help available");
-Object* newUserFunction(Object* argList, Object* bodyList, Environment& homeEnv);
+Object* newSyntax(const BuiltinDescriptor& descriptor);
+Object* newBuiltinFunction(const BuiltinDescriptor& descriptor);
+Object* newUserFunction(Object* argList,
+                        Object* bodyList,
+                        Object* slotNames,
+                        Environment& homeEnv,
+                        Object* code = NULL);
+Object* newLocalRef(Object* symbol, int depth, int slot);
+Object* newGlobalCell(Object* symbol);
+Object* newBytecode(BytecodeValue value);
+Object* newSpecialForm(FunctionTag syntax,
+                       Object* first,
+                       Object* second = NULL,
+                       Object* third = NULL);
+void destroyObject(Object* obj);
 
 extern Object* SCM_NIL;
 extern Object* SCM_VOID;
@@ -1,6 +1,8 @@
 #include "operations.hpp"
 #include <algorithm>
+#include <climits>
 #include <cmath>
+#include <functional>
 #include <iostream>
 #include <loguru.hpp>
 #include <numeric>
@@ -9,7 +11,10 @@
 #include <variant>
 #include <vector>
 #include "evaluate.hpp"
+#include "garbage_collection.hpp"
+#include "heap.hpp"
 #include "memory.hpp"
+#include "resolve.hpp"
 #include "scheme.hpp"
 #include "trampoline.hpp"
 
@@ -40,7 +45,7 @@ static Continuation* divFunction_Part1();
  * or the formatted code of a user define function. Prints the
  * value of other objects. If no argument is specified, show all
  * bindings of the current environment.
- * Expects parameters from the argument Stack.
+ * Expects its frame on the frame stack.
  * @param env environment from which to get the bindings
  * @param argumentCons the object the user requests help for
  * @returns VOID
@@ -48,19 +53,20 @@ static Continuation* divFunction_Part1();
 Continuation* helpSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: helpSyntax");
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
   Object* variable;
-  switch (argumentCons->tag) {
+  switch (getTag(argumentCons)) {
     case TAG_NIL:
       printEnv(*env);
       break;
     case TAG_CONS:
-      switch (getCar(argumentCons)->tag) {
+      switch (getTag(getCar(argumentCons))) {
         case TAG_SYMBOL: {
           variable = getVariable(*env, getCar(argumentCons));
           std::cout << "======== " << toString(getCar(argumentCons)) << " ========\n";
-          switch (variable->tag) {
+          switch (getTag(variable)) {
             case TAG_FUNC_BUILTIN:
             case TAG_SYNTAX:
               std::cout << getBuiltinFuncHelpText(variable) << '\n';
@@ -90,7 +96,7 @@ Continuation* helpSyntax()
 
 /**
  * Define a new variable in a given environment.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to define the variable
  * @param argumentCons: the arguments of the operation as a cons object
  * @returns continuation to either defineSyntax_Part1 or defineLambda
@@ -99,8 +105,9 @@ Continuation* defineSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: defineSyntax");
   // get arguments from stack
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
 
   Object *symbol, *value;
 
@@ -109,7 +116,7 @@ Continuation* defineSyntax()
   }
   // get key of definition
   symbol = getCar(argumentCons);
-  if (!isOneOf(symbol, {TAG_SYMBOL, TAG_CONS})) {
+  if (!isOneOf(symbol, {TAG_SYMBOL, TAG_LOCAL_REF, TAG_CONS})) {
     schemeThrow("can only define symbols or functions");
   }
 
@@ -118,7 +125,7 @@ Continuation* defineSyntax()
   // (define (funcname var1 var2 ...) (body))
   if (hasTag(symbol, TAG_CONS)) {
     // push arguments required for next part
-    pushArgs({env, getCar(symbol)});
+    pushFrame({env, getCar(symbol)});
     // call lambda then continue with next part
     return tCall(cont(lambdaSyntax),
                  cont(defineSyntax_Part1),
@@ -131,7 +138,7 @@ Continuation* defineSyntax()
       schemeThrow("define takes exactyly 2 arguments");
     }
     // push arguments required for next part
-    pushArgs({env, symbol});
+    pushFrame({env, symbol});
 
     // call evaluate then continue with next part
     return tCall(cont(evaluate), cont(defineSyntax_Part1), {env, getCar(value)});
@@ -140,7 +147,7 @@ Continuation* defineSyntax()
 
 /**
  * Continuation of defineSyntax, does the actual defining
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to define the variable
  * @param symbol: the key of the definition
  * @returns VOID
@@ -148,9 +155,10 @@ Continuation* defineSyntax()
 static Continuation* defineSyntax_Part1()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: defineSyntax Part1");
-  // get arguments from argument stack
-  Environment* env{popArg<Environment*>()};
-  Object* symbol{popArg<Object*>()};
+  // get locals from the frame stack
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* symbol{frame.expression};
   // get evaluated value of definition
   Object* value{lastReturnValue};
 
@@ -160,7 +168,7 @@ static Continuation* defineSyntax_Part1()
 
 /**
  * Set a new variable in a given environment and all of its parents.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to start
  * @param argumentCons: the arguments of the operation as a cons object
  * @returns continuation to setSyntax_Part1
@@ -168,8 +176,9 @@ static Continuation* defineSyntax_Part1()
 Continuation* setSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: setSyntax");
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
 
   Object *symbol, *expression;
 
@@ -185,7 +194,7 @@ Continuation* setSyntax()
     schemeThrow("set requires exactly two arguments: (set! {name} {value})");
   }
   // push arguments required for next part
-  pushArgs({env, symbol});
+  pushFrame({env, symbol});
 
   // call evaluate then continue with next part
   return tCall(cont(evaluate), cont(setSyntax_Part1), {env, expression});
@@ -193,7 +202,7 @@ Continuation* setSyntax()
 
 /**
  * Continuation of setSyntax, does the actual setting
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to start
  * @param symbol: the key of the definition
  * @returns VOID
@@ -201,8 +210,9 @@ Continuation* setSyntax()
 static Continuation* setSyntax_Part1()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: setSyntax_Part1");
-  Environment* env{popArg<Environment*>()};
-  Object* symbol{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* symbol{frame.expression};
   Object* value{lastReturnValue};
 
   set(*env, symbol, value);
@@ -211,7 +221,7 @@ static Continuation* setSyntax_Part1()
 
 /**
  * Return the unevaluated first argument of the expression.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to start
  * @param argumentCons: the arguments of the operation as a cons object
  * @returns the first argument
@@ -219,15 +229,45 @@ static Continuation* setSyntax_Part1()
 Continuation* quoteSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: quoteSyntax");
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
   Object* quoted = (hasTag(argumentCons, TAG_CONS)) ? getCar(argumentCons) : argumentCons;
   t_RETURN(quoted);
 }
 
+/**
+ * Decide whether a value counts as true when it's used as the condition of an if.
+ * @param condition the evaluated condition
+ * @throw schemeException if the value can't be used as a condition
+ * @returns true if the first branch is to be taken
+ */
+bool isTrue(Object* condition)
+{
+  switch (getTag(condition)) {
+    case scm::TAG_INT:
+      return getIntValue(condition) != 0;
+    case scm::TAG_FLOAT:
+      return getFloatValue(condition) != 0;
+    case scm::TAG_STRING:
+      return getStringValue(condition) == std::string{};
+    case scm::TAG_TRUE:
+    case scm::TAG_FUNC_BUILTIN:
+    case scm::TAG_FUNC_USER:
+    case scm::TAG_SYNTAX:
+      return true;
+    case scm::TAG_NIL:
+    case scm::TAG_FALSE:
+      return false;
+    default:
+      schemeThrow("evaluation not yet implemented for " + toString(condition) + " with tag " +
+                  tagToString(getTag(condition)));
+  }
+}
+
 /**
  * Return the first expression if a condition is true, second one otherwise.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * This part handles the evaluation of the condition.
  * @param env: the environment in which to start
  * @param argumentCons: the arguments of the operation as a cons object
@@ -236,8 +276,9 @@ Continuation* quoteSyntax()
 Continuation* ifSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: ifSyntax");
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
   Object *condition, *trueExpression, *falseExpression;
 
   // get all required Objects
@@ -255,7 +296,7 @@ Continuation* ifSyntax()
     schemeThrow("if requires 3 arguments: (if {condition} {true} {false})");
   }
   // push arguments required for next part
-  pushArgs({env, trueExpression, falseExpression});
+  pushFrame({env, trueExpression, falseExpression});
 
   // call evaluate then continue with next part
   return tCall(cont(evaluate), cont(ifSyntax_Part1), {env, condition});
@@ -264,7 +305,7 @@ Continuation* ifSyntax()
 /**
  * Continuation of ifSyntax. Returns the correct expression based on the value
  * of the previously evaluated condition.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to start
  * @param symbol: the key of the definition
  * @returns VOID
@@ -272,52 +313,18 @@ Continuation* ifSyntax()
 static Continuation* ifSyntax_Part1()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: ifSyntax Part1");
-  Environment* env{popArg<Environment*>()};
-  Object* trueExpression{popArg<Object*>()};
-  Object* falseExpression{popArg<Object*>()};
-
-  Object* evaluatedCondition{lastReturnValue};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* trueExpression{frame.expression};
+  Object* falseExpression{frame.rest};
 
-  Object* conditionAsBool;
-  switch (evaluatedCondition->tag) {
-    case scm::TAG_INT: {
-      conditionAsBool = (getIntValue(evaluatedCondition) != 0) ? SCM_TRUE : SCM_FALSE;
-      break;
-    }
-    case scm::TAG_FLOAT: {
-      conditionAsBool = (getFloatValue(evaluatedCondition) != 0) ? SCM_TRUE : SCM_FALSE;
-      break;
-    }
-    case scm::TAG_STRING: {
-      conditionAsBool =
-          (getStringValue(evaluatedCondition) == std::string{}) ? SCM_TRUE : SCM_FALSE;
-      break;
-    }
-    case scm::TAG_TRUE:
-    case scm::TAG_FUNC_BUILTIN:
-    case scm::TAG_FUNC_USER:
-    case scm::TAG_SYNTAX: {
-      conditionAsBool = SCM_TRUE;
-      break;
-    }
-    case scm::TAG_NIL:
-    case scm::TAG_FALSE: {
-      conditionAsBool = SCM_FALSE;
-      break;
-    }
-    default: {
-      schemeThrow("evaluation not yet implemented for " + toString(evaluatedCondition) +
-                  " with tag " + tagToString(evaluatedCondition->tag));
-      break;
-    }
-  }
-  Object* expression{(conditionAsBool == SCM_TRUE) ? trueExpression : falseExpression};
+  Object* expression{isTrue(lastReturnValue) ? trueExpression : falseExpression};
   return tCall(cont(evaluate), {env, expression});
 }
 
 /**
  * Evaluate a body of expressions and return the last result.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * This part only starts the process!
  * @param env: the environment in which to start
  * @param argumentCons: the arguments of the operation as a cons object
@@ -326,8 +333,9 @@ static Continuation* ifSyntax_Part1()
 Continuation* beginSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: beginSyntax");
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
   // because of this check we need to split the function
   // SCM_NIL is required as check for the end of cons objects
   if (argumentCons == SCM_NIL) {
@@ -340,7 +348,7 @@ Continuation* beginSyntax()
 
 /**
  * Continuation of beginSyntax, does the actual evaluation and loop.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to start
  * @param argumentCons: the arguments of the operation as a cons object
  * @returns one of the expressions
@@ -348,8 +356,9 @@ Continuation* beginSyntax()
 static Continuation* beginSyntax_Part1()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: beginSyntax Part1");
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
 
   Object* currentExpression = getCar(argumentCons);
   argumentCons = getCdr(argumentCons);
@@ -361,14 +370,14 @@ static Continuation* beginSyntax_Part1()
   }
   else {
     // push arguments for next part
-    pushArgs({env, argumentCons});
+    pushFrame({env, argumentCons});
     return tCall(cont(evaluate), cont(beginSyntax_Part1), {env, currentExpression});
   }
 }
 
 /**
  * Create a new user defined function.
- * Expects arguments as pop from argument stack.
+ * Expects its frame on the frame stack.
  * @param env: the environment in which to start
  * @param argumentCons: the arguments of the operation as a cons object
  * @see defineSyntax
@@ -378,8 +387,9 @@ Continuation* lambdaSyntax()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: lambdaSyntax");
   // get arguments from stack
-  Environment* env{popArg<Environment*>()};
-  Object* argumentCons{popArg<Object*>()};
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  Object* argumentCons{frame.expression};
 
   // try to get argument list and body list from arguments
   Object *argList, *bodyList;
@@ -390,11 +400,171 @@ Continuation* lambdaSyntax()
   catch (std::bad_variant_access& e) {
     schemeThrow("lambda requires at least two arguments: (lambda {argument} {body})");
   }
-  t_RETURN(newUserFunction(argList, bodyList, *env));
+
+  // lambdas created within a function body were already resolved along with the enclosing one
+  Environment& globalEnv{getGlobalEnvironment(*env)};
+  Object* slotNames{collectSlotNames(argList, bodyList, globalEnv)};
+  if (isGlobalEnvironment(*env)) {
+    bodyList = resolveLambdaBody(slotNames, bodyList, globalEnv);
+  }
+  t_RETURN(newUserFunction(argList, bodyList, slotNames, *env));
+}
+
+/**
+ * Evaluate a syntax form that was analyzed when its lambda was created. Its parts were checked
+ * already, so they're passed straight to the continuation doing the actual work.
+ * Expects its frame on the frame stack.
+ * @param env: the environment in which to start
+ * @param form: the special form object
+ * @see resolveLambdaBody
+ * @returns the continuation of the syntax
+ */
+Continuation* specialFormSyntax()
+{
+  DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: specialFormSyntax");
+  Frame frame{popFrame()};
+  Environment* env{frame.env};
+  const SpecialFormValue& form{getSpecialForm(frame.expression)};
+
+  switch (form.syntax) {
+    case SYNTAX_QUOTE:
+      t_RETURN(form.first);
+    case SYNTAX_IF:
+      pushFrame({env, form.second, form.third});
+      return tCall(cont(evaluate), cont(ifSyntax_Part1), {env, form.first});
+    case SYNTAX_DEFINE:
+      pushFrame({env, form.first});
+      return tCall(cont(evaluate), cont(defineSyntax_Part1), {env, form.second});
+    case SYNTAX_SET:
+      pushFrame({env, form.first});
+      return tCall(cont(evaluate), cont(setSyntax_Part1), {env, form.second});
+    case SYNTAX_BEGIN:
+      return tCall(cont(beginSyntax_Part1), {env, form.first});
+    case SYNTAX_LAMBDA:
+      t_RETURN(newUserFunction(form.first, form.second, form.third, *env));
+    default:
+      schemeThrow("undefined special form: " + toString(frame.expression));
+  }
 }
 
 // BUILTIN FUNCTIONS
 
+/**
+ * Turn the result of integer arithmetic into an integer object, if it fits.
+ * @param value the result, computed with more bits than an int has
+ * @returns the integer, NULL if it overflowed and has to be left to the general function
+ */
+static Object* fitInteger(long long value)
+{
+  if (value < INT_MIN || value > INT_MAX) {
+    return NULL;
+  }
+  return newInteger(static_cast<int>(value));
+}
+
+/**
+ * Shortcut of addFunction for two integers or two floats, the by far most common case.
+ * @param a the first summand
+ * @param b the second summand
+ * @returns the sum, NULL for other arguments or an overflow
+ */
+Object* addFastPath(Object* a, Object* b)
+{
+  if (isFixnum(a) && isFixnum(b)) {
+    return fitInteger(static_cast<long long>(fixnumValue(a)) + fixnumValue(b));
+  }
+  if (hasTag(a, TAG_FLOAT) && hasTag(b, TAG_FLOAT)) {
+    return newFloat(getFloatValue(a) + getFloatValue(b));
+  }
+  return NULL;
+}
+
+/**
+ * Shortcut of subFunction for two integers or two floats.
+ * @param a the minuend
+ * @param b the subtrahend
+ * @returns the difference, NULL for other arguments or an overflow
+ */
+Object* subFastPath(Object* a, Object* b)
+{
+  if (isFixnum(a) && isFixnum(b)) {
+    return fitInteger(static_cast<long long>(fixnumValue(a)) - fixnumValue(b));
+  }
+  if (hasTag(a, TAG_FLOAT) && hasTag(b, TAG_FLOAT)) {
+    return newFloat(getFloatValue(a) - getFloatValue(b));
+  }
+  return NULL;
+}
+
+/**
+ * Shortcut of multFunction for two integers or two floats.
+ * @param a the first factor
+ * @param b the second factor
+ * @returns the product, NULL for other arguments or an overflow
+ */
+Object* multFastPath(Object* a, Object* b)
+{
+  if (isFixnum(a) && isFixnum(b)) {
+    return fitInteger(static_cast<long long>(fixnumValue(a)) * fixnumValue(b));
+  }
+  if (hasTag(a, TAG_FLOAT) && hasTag(b, TAG_FLOAT)) {
+    return newFloat(getFloatValue(a) * getFloatValue(b));
+  }
+  return NULL;
+}
+
+/**
+ * Compare two integers or two floats.
+ * @tparam COMPARE a comparison function object like std::less<>
+ * @param a the first number
+ * @param b the second number
+ * @returns SCM_TRUE or SCM_FALSE, NULL for other arguments
+ */
+template <typename COMPARE>
+static Object* compareFastPath(Object* a, Object* b)
+{
+  if (isFixnum(a) && isFixnum(b)) {
+    return COMPARE{}(fixnumValue(a), fixnumValue(b)) ? SCM_TRUE : SCM_FALSE;
+  }
+  if (hasTag(a, TAG_FLOAT) && hasTag(b, TAG_FLOAT)) {
+    return COMPARE{}(getFloatValue(a), getFloatValue(b)) ? SCM_TRUE : SCM_FALSE;
+  }
+  return NULL;
+}
+
+/**
+ * Shortcut of equalNumberFunction for two integers or two floats.
+ * @param a the first number
+ * @param b the second number
+ * @returns SCM_TRUE or SCM_FALSE, NULL for other arguments
+ */
+Object* equalNumberFastPath(Object* a, Object* b)
+{
+  return compareFastPath<std::equal_to<>>(a, b);
+}
+
+/**
+ * Shortcut of greaterThanFunction for two integers or two floats.
+ * @param a the first number
+ * @param b the second number
+ * @returns SCM_TRUE or SCM_FALSE, NULL for other arguments
+ */
+Object* greaterThanFastPath(Object* a, Object* b)
+{
+  return compareFastPath<std::greater<>>(a, b);
+}
+
+/**
+ * Shortcut of lesserThanFunction for two integers or two floats.
+ * @param a the first number
+ * @param b the second number
+ * @returns SCM_TRUE or SCM_FALSE, NULL for other arguments
+ */
+Object* lesserThanFastPath(Object* a, Object* b)
+{
+  return compareFastPath<std::less<>>(a, b);
+}
+
 /**
  * Function that handles the addition or concatenation of multiple scm::Objects
  * @param nArgs: how many arguments the function should take from the stack
@@ -403,16 +573,17 @@ Continuation* lambdaSyntax()
 Continuation* addFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: addFunction");
-  int nArgs{popArg<int>()};
+  int nArgs{popFrame().count};
   DLOG_IF_F(INFO, LOG_STACK_TRACE, "nArgs = %d", nArgs);
 
   // get all arguments necessary and check for type validity
   if (nArgs <= 0) {
     schemeThrow("expected at least 1 argument");
   }
-  auto arguments = popArgs<Object*>(nArgs);
+  Object** arguments{popValues(nArgs)};
+  Object** argumentsEnd{arguments + nArgs};
   auto isValidType = [](Object* obj) { return isOneOf(obj, {TAG_INT, TAG_FLOAT, TAG_STRING}); };
-  if (!std::all_of(arguments.begin(), arguments.end(), isValidType)) {
+  if (!std::all_of(arguments, argumentsEnd, isValidType)) {
     schemeThrow("invalid types for add function!\n");
   }
 
@@ -422,24 +593,24 @@ Continuation* addFunction()
   // defaults to integers
 
   // case: at least one string
-  if (std::any_of(arguments.begin(), arguments.end(), isString)) {
+  if (std::any_of(arguments, argumentsEnd, isString)) {
     auto lambda = [](std::string a, Object* b) {
       if (hasTag(b, TAG_STRING)) {
-        return getStringValue(b) + a;
+        return a + getStringValue(b);
       }
       else if (hasTag(b, TAG_FLOAT)) {
-        return std::to_string(getFloatValue(b)) + a;
+        return a + std::to_string(getFloatValue(b));
       }
       else {
-        return std::to_string(getIntValue(b)) + a;
+        return a + std::to_string(getIntValue(b));
       }
     };
-    std::string result = std::accumulate(arguments.begin(), arguments.end(), std::string{}, lambda);
+    std::string result = std::accumulate(arguments, argumentsEnd, std::string{}, lambda);
     t_RETURN(newString(result));
   }
 
   // case: at least one float
-  else if (std::any_of(arguments.begin(), arguments.end(), isFloatingPoint)) {
+  else if (std::any_of(arguments, argumentsEnd, isFloatingPoint)) {
     auto lambda = [](double a, Object* b) {
       if (hasTag(b, TAG_FLOAT)) {
         return getFloatValue(b) + a;
@@ -448,7 +619,7 @@ Continuation* addFunction()
         return static_cast<double>(getIntValue(b) + a);
       }
     };
-    double result = std::accumulate(arguments.begin(), arguments.end(), double(0.0), lambda);
+    double result = std::accumulate(arguments, argumentsEnd, double(0.0), lambda);
     t_RETURN(newFloat(result));
   }
 
@@ -462,7 +633,7 @@ Continuation* addFunction()
       }
       return result;
     };
-    double result = std::accumulate(arguments.begin(), arguments.end(), 0, lambda);
+    double result = std::accumulate(arguments, argumentsEnd, 0, lambda);
     t_RETURN(newInteger(result));
   }
 }
@@ -475,35 +646,41 @@ Continuation* addFunction()
 Continuation* subFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: subFunction");
-  int nArgs{popArg<int>()};
-  auto subtrahends = popArgs<Object*>(nArgs - 1);
+  int nArgs{popFrame().count};
+  if (nArgs <= 0) {
+    schemeThrow("expected at least 1 argument");
+  }
+  Object** arguments{popValues(nArgs)};
+  // the first argument is the minuend, all following ones are subtracted from it
+  Object** subtrahends{arguments + 1};
+  Object** subtrahendsEnd{arguments + nArgs};
   int intSubtrahend{};
   double doubleSubtrahend;
   // TODO: this is a really ugly hack, fix this! it works, but gives the option for floating point
   // errors
-  Object* minuendObj = popArg<Object*>();
+  Object* minuendObj = arguments[0];
   double minuend = hasTag(minuendObj, TAG_FLOAT) ? getFloatValue(minuendObj)
                                                  : static_cast<double>(getIntValue(minuendObj));
 
-  if (subtrahends.size() == 0) {
+  if (nArgs == 1) {
     if (hasTag(minuendObj, TAG_FLOAT))
       t_RETURN(newFloat(-getFloatValue(minuendObj)));
     t_RETURN(newInteger(-getIntValue(minuendObj)));
   }
   else if (hasTag(minuendObj, TAG_FLOAT) ||
-           std::any_of(subtrahends.begin(), subtrahends.end(), isFloatingPoint)) {
+           std::any_of(subtrahends, subtrahendsEnd, isFloatingPoint)) {
     auto lambda = [](double a, Object* b) {
       if (hasTag(b, TAG_INT)) {
         return a + static_cast<double>(getIntValue(b));
       }
       return a + getFloatValue(b);
     };
-    doubleSubtrahend = std::accumulate(subtrahends.begin(), subtrahends.end(), double(0.0), lambda);
+    doubleSubtrahend = std::accumulate(subtrahends, subtrahendsEnd, double(0.0), lambda);
     t_RETURN(newFloat(minuend - doubleSubtrahend));
   }
   else {
     auto lambda = [](int a, Object* b) { return a + getIntValue(b); };
-    intSubtrahend = std::accumulate(subtrahends.begin(), subtrahends.end(), int(0), lambda);
+    intSubtrahend = std::accumulate(subtrahends, subtrahendsEnd, int(0), lambda);
     t_RETURN(newInteger(static_cast<int>(minuend) - intSubtrahend));
   }
 }
@@ -516,20 +693,21 @@ Continuation* subFunction()
 Continuation* multFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: multFunction");
-  int nArgs{popArg<int>()};
-  ObjectVec arguments{popArgs<Object*>(nArgs)};
+  int nArgs{popFrame().count};
+  Object** arguments{popValues(nArgs)};
+  Object** argumentsEnd{arguments + nArgs};
   auto isValidType = [](Object* obj) { return isOneOf(obj, {TAG_INT, TAG_FLOAT}); };
-  if (!std::all_of(arguments.begin(), arguments.end(), isValidType)) {
+  if (!std::all_of(arguments, argumentsEnd, isValidType)) {
     schemeThrow("invalid type for multiplication");
   }
-  else if (std::any_of(arguments.begin(), arguments.end(), isFloatingPoint)) {
+  else if (std::any_of(arguments, argumentsEnd, isFloatingPoint)) {
     auto lambda = [](double a, Object* b) {
       if (hasTag(b, TAG_INT)) {
         return static_cast<double>(getIntValue(b)) * a;
       }
       return a * getFloatValue(b);
     };
-    t_RETURN(newFloat(std::accumulate(arguments.begin(), arguments.end(), double(1), lambda)));
+    t_RETURN(newFloat(std::accumulate(arguments, argumentsEnd, double(1), lambda)));
   }
   else {
     auto lambda = [](int a, Object* b) {
@@ -540,7 +718,7 @@ Continuation* multFunction()
       }
       return a * getIntValue(b);
     };
-    t_RETURN(newInteger(std::accumulate(arguments.begin(), arguments.end(), int{1}, lambda)));
+    t_RETURN(newInteger(std::accumulate(arguments, argumentsEnd, int{1}, lambda)));
   }
 }
 
@@ -553,11 +731,11 @@ Continuation* multFunction()
 Continuation* divFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: divFunction");
-  int nArgs{popArg<int>()};
+  int nArgs{popFrame().count};
   if (nArgs < 2) {
     schemeThrow("division needs at least 2 arguments");
   }
-  return tCall(cont(multFunction), cont(divFunction_Part1), {nArgs - 1});
+  return tCall(cont(multFunction), cont(divFunction_Part1), {NULL, NULL, NULL, nArgs - 1});
 }
 
 /**
@@ -568,7 +746,7 @@ Continuation* divFunction()
 Continuation* divFunction_Part1()
 {
   Object* divisor{lastReturnValue};
-  Object* dividend{popArg<Object*>()};
+  Object* dividend{popValue()};
 
   if (isFloatingPoint(dividend) && isFloatingPoint(divisor)) {
     t_RETURN(newFloat(getFloatValue(dividend) / getFloatValue(divisor)));
@@ -605,9 +783,9 @@ Object* applyFunction()
 Continuation* eqFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: eqFunction");
-  int nArgs{popArg<int>()};
-  Object* b{popArg<Object*>()};
-  Object* a{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* b{popValue()};
+  Object* a{popValue()};
   t_RETURN((a == b) ? SCM_TRUE : SCM_FALSE);
 }
 
@@ -619,9 +797,9 @@ Continuation* eqFunction()
 Continuation* equalStringFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: equalStringFunction");
-  int nArgs{popArg<int>()};
-  Object* b{popArg<Object*>()};
-  Object* a{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* b{popValue()};
+  Object* a{popValue()};
   if (!isString(a) || !isString(b)) {
     schemeThrow("equal-string? only works with strings");
   }
@@ -638,9 +816,9 @@ Continuation* equalStringFunction()
 Continuation* equalNumberFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: equalNumberFunction");
-  int nArgs{popArg<int>()};
-  Object* b{popArg<Object*>()};
-  Object* a{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* b{popValue()};
+  Object* a{popValue()};
   if (!isNumeric(a) || !isNumeric(b)) {
     schemeThrow("= only works with numbers");
   }
@@ -666,9 +844,9 @@ Continuation* equalNumberFunction()
 Continuation* greaterThanFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: greaterThanFunction");
-  int nArgs{popArg<int>()};
-  Object* b{popArg<Object*>()};
-  Object* a{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* b{popValue()};
+  Object* a{popValue()};
   if (!isNumeric(a) || !isNumeric(b)) {
     schemeThrow("= only works with numbers");
   }
@@ -694,9 +872,9 @@ Continuation* greaterThanFunction()
 Continuation* lesserThanFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: lesserThanFunction");
-  int nArgs{popArg<int>()};
-  Object* b{popArg<Object*>()};
-  Object* a{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* b{popValue()};
+  Object* a{popValue()};
   if (!isNumeric(a) || !isNumeric(b)) {
     schemeThrow("= only works with numbers");
   }
@@ -722,9 +900,9 @@ Continuation* lesserThanFunction()
 Continuation* consFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: consFunction");
-  int nArgs{popArg<int>()};
-  Object* cdr{popArg<Object*>()};
-  Object* car{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* cdr{popValue()};
+  Object* car{popValue()};
   t_RETURN(newCons(car, cdr));
 }
 
@@ -736,8 +914,8 @@ Continuation* consFunction()
 Continuation* carFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: carFunction");
-  int nArgs{popArg<int>()};
-  Object* cons{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* cons{popValue()};
   if (!hasTag(cons, TAG_CONS)) {
     schemeThrow("trying to get car value from non-cons object");
   }
@@ -752,8 +930,8 @@ Continuation* carFunction()
 Continuation* cdrFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: cdrFunction");
-  int nArgs{popArg<int>()};
-  Object* cons{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* cons{popValue()};
   if (!hasTag(cons, TAG_CONS)) {
     schemeThrow("trying to get cdr value from non-cons object");
   }
@@ -768,10 +946,10 @@ Continuation* cdrFunction()
 Continuation* listFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: listFunction");
-  int nArgs{popArg<int>()};
+  int nArgs{popFrame().count};
   Object* rest = SCM_NIL;
   while (nArgs--) {
-    Object* currentArgument{popArg<Object*>()};
+    Object* currentArgument{popValue()};
     rest = newCons(currentArgument, rest);
   }
   t_RETURN(rest);
@@ -785,10 +963,10 @@ Continuation* listFunction()
 Continuation* displayFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: displayFunction");
-  int nArgs{popArg<int>()};
-  ObjectVec arguments{popArgs<Object*>(nArgs)};
-  for (auto argument{arguments.rbegin()}; argument != arguments.rend(); argument++) {
-    std::cout << toString(*argument) << " ";
+  int nArgs{popFrame().count};
+  Object** arguments{popValues(nArgs)};
+  for (int i{0}; i < nArgs; i++) {
+    std::cout << toString(arguments[i]) << " ";
   }
   std::cout << '\n';
   t_RETURN(SCM_VOID);
@@ -802,8 +980,8 @@ Continuation* displayFunction()
 Continuation* functionBodyFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: functionBodyFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   if (!hasTag(obj, TAG_FUNC_USER)) {
     schemeThrow("function body is not a lambda");
   }
@@ -818,8 +996,8 @@ Continuation* functionBodyFunction()
 Continuation* functionArglistFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: functionArglistFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   if (!hasTag(obj, TAG_FUNC_USER)) {
     schemeThrow("function arglist is not a lambda");
   }
@@ -834,8 +1012,8 @@ Continuation* functionArglistFunction()
 Continuation* isStringFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: isStringFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   t_RETURN((isString(obj)) ? SCM_TRUE : SCM_FALSE);
 }
 
@@ -847,8 +1025,8 @@ Continuation* isStringFunction()
 Continuation* isNumberFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: isNumberFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   t_RETURN((isNumeric(obj)) ? SCM_TRUE : SCM_FALSE);
 }
 
@@ -860,8 +1038,8 @@ Continuation* isNumberFunction()
 Continuation* isConsFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: isConsFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   t_RETURN((hasTag(obj, TAG_CONS)) ? SCM_TRUE : SCM_FALSE);
 }
 
@@ -873,8 +1051,8 @@ Continuation* isConsFunction()
 Continuation* isBuiltinFunctionFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: isBuiltinFunctionFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   t_RETURN((hasTag(obj, TAG_FUNC_BUILTIN)) ? SCM_TRUE : SCM_FALSE);
 }
 
@@ -886,8 +1064,8 @@ Continuation* isBuiltinFunctionFunction()
 Continuation* isUserFunctionFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: isUserFunctionFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   t_RETURN((hasTag(obj, TAG_FUNC_USER)) ? SCM_TRUE : SCM_FALSE);
 }
 
@@ -900,10 +1078,87 @@ Continuation* isUserFunctionFunction()
 Continuation* isBoolFunction()
 {
   DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: isBoolFunction");
-  int nArgs{popArg<int>()};
-  Object* obj{popArg<Object*>()};
+  int nArgs{popFrame().count};
+  Object* obj{popValue()};
   t_RETURN((isOneOf(obj, {TAG_TRUE, TAG_FALSE})) ? SCM_TRUE : SCM_FALSE);
 }
 
+/**
+ * Create a number for a count or size, integers only hold 32 bits so larger ones become floats.
+ * @param value the count
+ * @returns an integer if the value fits, a float otherwise
+ */
+static Object* newCount(double value)
+{
+  return value <= INT_MAX ? newInteger(static_cast<int>(value)) : newFloat(value);
+}
+
+/**
+ * Build an association list, a list of (key . value) pairs.
+ * @param entries the keys and values in the order they should appear
+ * @returns the list
+ */
+static Object* newAssociationList(const std::vector<std::pair<std::string, Object*>>& entries)
+{
+  Object* list{SCM_NIL};
+  for (auto entry{entries.rbegin()}; entry != entries.rend(); entry++) {
+    list = newCons(newCons(newSymbol(entry->first), entry->second), list);
+  }
+  return list;
+}
+
+/**
+ * Returns what the garbage collector did so far and how large the heap is.
+ * @param nArgs: how many arguments the function should take from the stack
+ * @returns an association list of the statistics
+ */
+Continuation* gcStatsFunction()
+{
+  DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: gcStatsFunction");
+  int nArgs{popFrame().count};
+  const CollectionStatistics& statistics{getCollectionStatistics()};
+  const std::array<long, N_PAUSE_BUCKETS>& pauses{statistics.pauseHistogram};
+  Object* histogram{newAssociationList({{"<10us", newCount(pauses[0])},
+                                        {"<100us", newCount(pauses[1])},
+                                        {"<1ms", newCount(pauses[2])},
+                                        {"<10ms", newCount(pauses[3])},
+                                        {"<100ms", newCount(pauses[4])},
+                                        {">=100ms", newCount(pauses[5])}})};
+  t_RETURN(newAssociationList(
+      {{"full-collections", newCount(statistics.nFullCollections)},
+       {"young-collections", newCount(statistics.nYoungCollections)},
+       {"slices", newCount(statistics.nSlices)},
+       {"pauses", newCount(statistics.nPauses)},
+       {"pause-total-us", newFloat(statistics.totalPauseMicroseconds)},
+       {"pause-max-us", newFloat(statistics.maxPauseMicroseconds)},
+       {"pause-histogram", histogram},
+       {"bytes-allocated", newCount(static_cast<double>(heap::getTotalAllocatedBytes()))},
+       {"bytes-in-use", newCount(static_cast<double>(heap::getAllocatedBytes()))},
+       {"heap-bytes", newCount(static_cast<double>(heap::getMappedBytes()))}}));
+}
+
+/**
+ * Counts the objects on the heap per type.
+ * @param nArgs: how many arguments the function should take from the stack
+ * @returns a list of (type objects bytes) lists, one for every type with objects on the heap
+ */
+Continuation* heapCensusFunction()
+{
+  DLOG_IF_F(INFO, LOG_TRAMPOLINE_TRACE, "in: heapCensusFunction");
+  int nArgs{popFrame().count};
+  std::vector<CensusEntry> census{takeHeapCensus()};
+  Object* list{SCM_NIL};
+  for (int tag{static_cast<int>(census.size()) - 1}; tag > 0; tag--) {
+    if (census[tag].nObjects > 0) {
+      std::string name{tagToString(static_cast<ObjectTypeTag>(tag))};
+      std::replace(name.begin(), name.end(), ' ', '-');
+      Object* entry{newCons(newCount(census[tag].nObjects),
+                            newCons(newCount(static_cast<double>(census[tag].nBytes)), SCM_NIL))};
+      list = newCons(newCons(newSymbol(name), entry), list);
+    }
+  }
+  t_RETURN(list);
+}
+
 }  // namespace trampoline
 }  // namespace scm
\ No newline at end of file
@@ -13,6 +13,8 @@ Continuation* ifSyntax();
 Continuation* beginSyntax();
 Continuation* lambdaSyntax();
 Continuation* helpSyntax();
+Continuation* specialFormSyntax();
+bool isTrue(Object* condition);
 
 // BUILTIN FUNCTIONS
 Continuation* addFunction();
@@ -38,6 +40,16 @@ Continuation* isConsFunction();
 Continuation* isBuiltinFunctionFunction();
 Continuation* isUserFunctionFunction();
 Continuation* isBoolFunction();
+Continuation* gcStatsFunction();
+Continuation* heapCensusFunction();
+
+// FAST PATHS OF BUILTIN FUNCTIONS
+Object* addFastPath(Object* a, Object* b);
+Object* subFastPath(Object* a, Object* b);
+Object* multFastPath(Object* a, Object* b);
+Object* equalNumberFastPath(Object* a, Object* b);
+Object* greaterThanFastPath(Object* a, Object* b);
+Object* lesserThanFastPath(Object* a, Object* b);
 
 // USER DEFINED FUNCTIONS
 
@@ -3,10 +3,10 @@
 #include <loguru.hpp>
 #include "environment.hpp"
 #include "evaluate.hpp"
-#include "garbage_collection.hpp"
 #include "memory.hpp"
 #include "parse.hpp"
 #include "scheme.hpp"
+#include "trampoline.hpp"
 
 #if defined(__APPLE__) || defined(__unix__)
 #include <stdio.h>
@@ -56,15 +56,14 @@ void repl(scm::Environment& env, std::istream* streamPtr, bool isFile)
       if (!isFile) {
         std::cout << '\n';
       }
-
-      // collect garbage if necessary
-      markAndSweep(env);
     }
     catch (scm::schemeException& e) {
       std::cerr << e.what() << '\n';
+      scm::trampoline::initializeEvaluationStacks();
     }
     catch (std::exception& e) {
       std::cerr << "[CPP::ERROR] " << e.what() << '\n';
+      scm::trampoline::initializeEvaluationStacks();
     }
   } while (true);  // LOOP!
 };
@@ -0,0 +1,374 @@
+#include "resolve.hpp"
+#include <algorithm>
+#include <loguru.hpp>
+#include <vector>
+#include "environment.hpp"
+#include "memory.hpp"
+#include "scheme.hpp"
+
+namespace scm {
+
+/**
+ * The local variables visible at a certain point of a lambda body, one Scope per lambda.
+ * The index of a name within `names` is its slot in the frame of the function call.
+ */
+struct Scope {
+  std::vector<Object*> names;
+  const Scope* parent;
+};
+
+/**
+ * Check whether an operator refers to one of the builtin syntax elements. Locally bound names
+ * shadow syntax, so only unresolved symbols are looked up in the top level environment.
+ * @param operation the first element of an expression
+ * @param globalEnv the top level environment of the lambda
+ * @returns the syntax object, NULL if the operator isn't syntax
+ */
+static Object* getSyntax(Object* operation, Environment& globalEnv)
+{
+  if (!hasTag(operation, TAG_SYMBOL)) {
+    return NULL;
+  }
+  Object* value{getVariable(globalEnv, operation)};
+  return (value != NULL && hasTag(value, TAG_SYNTAX)) ? value : NULL;
+}
+
+/**
+ * Find the lexical address of a variable.
+ * @param scope the innermost scope
+ * @param symbol the name of the variable
+ * @param depth set to the number of scopes between the reference and the variable
+ * @param slot set to the index of the variable within its scope
+ * @returns true if the variable is local, false if it has to be looked up dynamically
+ */
+static bool lookupScope(const Scope* scope, Object* symbol, int& depth, int& slot)
+{
+  for (depth = 0; scope != NULL; scope = scope->parent, depth++) {
+    for (std::size_t i{0}; i < scope->names.size(); i++) {
+      if (scope->names[i] == symbol) {
+        slot = static_cast<int>(i);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * Add the target of a definition to the local variables of a lambda.
+ * Unresolved bodies contain symbols, already resolved ones contain references to slots.
+ * @param names the names collected so far
+ * @param target the defined symbol or local reference
+ */
+static void addSlotName(std::vector<Object*>& names, Object* target)
+{
+  if (hasTag(target, TAG_LOCAL_REF)) {
+    const LocalRefValue& ref{getLocalRef(target)};
+    if (ref.depth != 0) {
+      return;
+    }
+    auto slot{static_cast<std::size_t>(ref.slot)};
+    if (names.size() <= slot) {
+      names.resize(slot + 1, NULL);
+    }
+    names[slot] = ref.symbol;
+  }
+  else if (hasTag(target, TAG_SYMBOL) &&
+           std::find(names.begin(), names.end(), target) == names.end()) {
+    names.push_back(target);
+  }
+}
+
+static void collectDefinitions(std::vector<Object*>& names,
+                               Object* expression,
+                               Environment& globalEnv);
+
+/**
+ * Collect all variables defined by a syntax form that was analyzed along with an enclosing
+ * lambda, its target is resolved already.
+ * @param names the names collected so far
+ * @param form the special form to search
+ * @param globalEnv the top level environment of the lambda
+ */
+static void collectFormDefinitions(std::vector<Object*>& names,
+                                   const SpecialFormValue& form,
+                                   Environment& globalEnv)
+{
+  switch (form.syntax) {
+    case SYNTAX_DEFINE:
+      addSlotName(names, form.first);
+      collectDefinitions(names, form.second, globalEnv);
+      break;
+    case SYNTAX_SET:
+      collectDefinitions(names, form.second, globalEnv);
+      break;
+    case SYNTAX_IF:
+      collectDefinitions(names, form.first, globalEnv);
+      collectDefinitions(names, form.second, globalEnv);
+      collectDefinitions(names, form.third, globalEnv);
+      break;
+    case SYNTAX_BEGIN:
+      for (Object* list{form.first}; hasTag(list, TAG_CONS); list = getCdr(list)) {
+        collectDefinitions(names, getCar(list), globalEnv);
+      }
+      break;
+    // quoted expressions and nested lambdas don't define anything in this frame
+    default:
+      break;
+  }
+}
+
+/**
+ * Collect all variables defined by an expression of a lambda body. Nested lambdas and quoted
+ * expressions are skipped, as they don't define anything in the frame of this lambda.
+ * @param names the names collected so far
+ * @param expression the expression to search
+ * @param globalEnv the top level environment of the lambda
+ */
+static void collectDefinitions(std::vector<Object*>& names,
+                               Object* expression,
+                               Environment& globalEnv)
+{
+  if (hasTag(expression, TAG_SPECIAL_FORM)) {
+    collectFormDefinitions(names, getSpecialForm(expression), globalEnv);
+    return;
+  }
+  if (!hasTag(expression, TAG_CONS)) {
+    return;
+  }
+  Object* syntax{getSyntax(getCar(expression), globalEnv)};
+  Object* arguments{getCdr(expression)};
+  if (syntax != NULL) {
+    switch (getBuiltinFuncTag(syntax)) {
+      case SYNTAX_QUOTE:
+      case SYNTAX_LAMBDA:
+      case SYNTAX_HELP:
+        return;
+      case SYNTAX_DEFINE:
+        if (hasTag(arguments, TAG_CONS)) {
+          Object* target{getCar(arguments)};
+          // shorthand lambda definition, only the name belongs to this frame
+          if (hasTag(target, TAG_CONS)) {
+            addSlotName(names, getCar(target));
+            return;
+          }
+          addSlotName(names, target);
+          arguments = getCdr(arguments);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  for (; hasTag(arguments, TAG_CONS); arguments = getCdr(arguments)) {
+    collectDefinitions(names, getCar(arguments), globalEnv);
+  }
+}
+
+/**
+ * Check whether a lambda can be created from an argument list without an error.
+ * @param argList the argument list of the lambda
+ * @returns true if it's a proper list of symbols
+ */
+bool isArgumentList(Object* argList)
+{
+  for (; hasTag(argList, TAG_CONS); argList = getCdr(argList)) {
+    if (!hasTag(getCar(argList), TAG_SYMBOL)) {
+      return false;
+    }
+  }
+  return argList == SCM_NIL;
+}
+
+/**
+ * Determine the frame layout of a lambda: its arguments followed by all variables defined in
+ * its body. Works on unresolved bodies as well as on bodies that were resolved as part of an
+ * enclosing lambda.
+ * @param argList the argument list of the lambda
+ * @param bodyList the list of body expressions of the lambda
+ * @param globalEnv the top level environment of the lambda
+ * @throw schemeException if an argument isn't a symbol
+ * @returns a list of symbols, one per frame slot
+ */
+Object* collectSlotNames(Object* argList, Object* bodyList, Environment& globalEnv)
+{
+  std::vector<Object*> names;
+  for (; hasTag(argList, TAG_CONS); argList = getCdr(argList)) {
+    if (!hasTag(getCar(argList), TAG_SYMBOL)) {
+      schemeThrow("function arguments have to be symbols: " + toString(getCar(argList)));
+    }
+    names.push_back(getCar(argList));
+  }
+  for (; hasTag(bodyList, TAG_CONS); bodyList = getCdr(bodyList)) {
+    collectDefinitions(names, getCar(bodyList), globalEnv);
+  }
+  Object* slotNames{SCM_NIL};
+  for (auto name{names.rbegin()}; name != names.rend(); name++) {
+    slotNames = newCons(*name, slotNames);
+  }
+  return slotNames;
+}
+
+static Object* resolveExpression(Object* expression, const Scope& scope, Environment& globalEnv);
+
+/**
+ * Resolve every element of a list of expressions.
+ * @param list the expressions to resolve
+ * @param scope the innermost scope
+ * @param globalEnv the top level environment of the lambda
+ * @returns a new list with the resolved expressions
+ */
+static Object* resolveList(Object* list, const Scope& scope, Environment& globalEnv)
+{
+  if (!hasTag(list, TAG_CONS)) {
+    return list;
+  }
+  Object* car{resolveExpression(getCar(list), scope, globalEnv)};
+  return newCons(car, resolveList(getCdr(list), scope, globalEnv));
+}
+
+/**
+ * Resolve the body of a lambda nested within the expression that's currently resolved.
+ * @param slotNames the frame layout of the nested lambda as returned by collectSlotNames
+ * @param bodyList the body of the nested lambda
+ * @param scope the scope enclosing the nested lambda
+ * @param globalEnv the top level environment
+ * @returns the resolved body
+ */
+static Object* resolveNestedBody(Object* slotNames,
+                                 Object* bodyList,
+                                 const Scope& scope,
+                                 Environment& globalEnv)
+{
+  Scope innerScope{{}, &scope};
+  for (Object* name{slotNames}; name != SCM_NIL; name = getCdr(name)) {
+    innerScope.names.push_back(getCar(name));
+  }
+  return resolveList(bodyList, innerScope, globalEnv);
+}
+
+/**
+ * Replace all references to local variables within an expression by their lexical address and
+ * all other variables by the value cell of the top level variable of that name.
+ * Quoted expressions and the arguments of help are left untouched. Syntax forms of a valid
+ * shape are analyzed into special forms, which the trampoline evaluates without looking up
+ * their syntax or checking their arguments again.
+ * @param expression the expression to resolve
+ * @param scope the innermost scope
+ * @param globalEnv the top level environment of the lambda
+ * @returns the resolved expression
+ */
+static Object* resolveExpression(Object* expression, const Scope& scope, Environment& globalEnv)
+{
+  int depth, slot;
+  if (hasTag(expression, TAG_SYMBOL)) {
+    if (lookupScope(&scope, expression, depth, slot)) {
+      return newLocalRef(expression, depth, slot);
+    }
+    return getGlobalCellOf(globalEnv, expression);
+  }
+  if (!hasTag(expression, TAG_CONS)) {
+    return expression;
+  }
+
+  Object* operation{getCar(expression)};
+  Object* arguments{getCdr(expression)};
+  Object* syntax{lookupScope(&scope, operation, depth, slot) ? NULL
+                                                             : getSyntax(operation, globalEnv)};
+  if (syntax == NULL) {
+    return resolveList(expression, scope, globalEnv);
+  }
+  // without arguments the operator has to stay a symbol, or the syntax is called like a function
+  if (!hasTag(arguments, TAG_CONS)) {
+    // '() is read as (quote), which evaluates to nil
+    if (getBuiltinFuncTag(syntax) == SYNTAX_QUOTE) {
+      return newSpecialForm(SYNTAX_QUOTE, arguments);
+    }
+    return expression;
+  }
+  int nArguments{listLength(arguments)};
+  switch (getBuiltinFuncTag(syntax)) {
+    case SYNTAX_QUOTE:
+      return newSpecialForm(SYNTAX_QUOTE, getCar(arguments));
+    case SYNTAX_HELP:
+      return expression;
+    case SYNTAX_LAMBDA: {
+      Object* argList{getCar(arguments)};
+      Object* slotNames{collectSlotNames(argList, getCdr(arguments), globalEnv)};
+      Object* body{resolveNestedBody(slotNames, getCdr(arguments), scope, globalEnv)};
+      if (isArgumentList(argList)) {
+        return newSpecialForm(SYNTAX_LAMBDA, argList, body, slotNames);
+      }
+      return newCons(operation, newCons(argList, body));
+    }
+    case SYNTAX_DEFINE: {
+      Object* target{getCar(arguments)};
+      // shorthand lambda definition: (define (name args...) body...)
+      if (hasTag(target, TAG_CONS)) {
+        Object* name{resolveExpression(getCar(target), scope, globalEnv)};
+        Object* argList{getCdr(target)};
+        Object* slotNames{collectSlotNames(argList, getCdr(arguments), globalEnv)};
+        Object* body{resolveNestedBody(slotNames, getCdr(arguments), scope, globalEnv)};
+        if (hasTag(name, TAG_LOCAL_REF) && isArgumentList(argList)) {
+          Object* lambda{newSpecialForm(SYNTAX_LAMBDA, argList, body, slotNames)};
+          return newSpecialForm(SYNTAX_DEFINE, name, lambda);
+        }
+        return newCons(operation, newCons(newCons(name, argList), body));
+      }
+      if (hasTag(target, TAG_SYMBOL) && nArguments == 2) {
+        return newSpecialForm(SYNTAX_DEFINE,
+                              resolveExpression(target, scope, globalEnv),
+                              resolveExpression(getCar(getCdr(arguments)), scope, globalEnv));
+      }
+      return newCons(operation, resolveList(arguments, scope, globalEnv));
+    }
+    case SYNTAX_IF:
+      if (nArguments == 3) {
+        Object* condition{resolveExpression(getCar(arguments), scope, globalEnv)};
+        arguments = getCdr(arguments);
+        Object* consequent{resolveExpression(getCar(arguments), scope, globalEnv)};
+        Object* alternative{resolveExpression(getCar(getCdr(arguments)), scope, globalEnv)};
+        return newSpecialForm(SYNTAX_IF, condition, consequent, alternative);
+      }
+      break;
+    case SYNTAX_SET:
+      if (nArguments == 2) {
+        return newSpecialForm(SYNTAX_SET,
+                              resolveExpression(getCar(arguments), scope, globalEnv),
+                              resolveExpression(getCar(getCdr(arguments)), scope, globalEnv));
+      }
+      break;
+    case SYNTAX_BEGIN:
+      return newSpecialForm(SYNTAX_BEGIN, resolveList(arguments, scope, globalEnv));
+    default:
+      break;
+  }
+  // forms of any other shape are left to the syntax itself, which reports the error
+  return newCons(operation, resolveList(arguments, scope, globalEnv));
+}
+
+/**
+ * Resolve the body of a lambda created in a top level environment. Every reference to a local
+ * variable of this lambda or of a lambda nested in it is replaced by its frame depth and slot,
+ * so evaluating it is an indexed load instead of a lookup by name. All other variables are
+ * global, they are replaced by their value cell, which define and set! update in place.
+ * Syntax forms become special forms, so the work of quote, if, define, set!, begin and lambda
+ * that doesn't depend on the values is done once here instead of on every call.
+ * Nested lambdas are resolved as part of this.
+ * @param slotNames the frame layout of the lambda as returned by collectSlotNames
+ * @param bodyList the list of body expressions of the lambda
+ * @param globalEnv the top level environment of the lambda
+ * @returns the resolved body, the original body is left untouched
+ */
+Object* resolveLambdaBody(Object* slotNames, Object* bodyList, Environment& globalEnv)
+{
+  Scope scope{{}, NULL};
+  for (Object* name{slotNames}; name != SCM_NIL; name = getCdr(name)) {
+    scope.names.push_back(getCar(name));
+  }
+  Object* resolved{resolveList(bodyList, scope, globalEnv)};
+  DLOG_IF_F(INFO, LOG_EVALUATION, "resolved lambda body to %s", toString(resolved).c_str());
+  return resolved;
+}
+
+}  // namespace scm
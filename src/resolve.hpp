@@ -0,0 +1,11 @@
+#pragma once
+#include "environment.hpp"
+#include "scheme.hpp"
+
+namespace scm {
+
+bool isArgumentList(Object* argList);
+Object* collectSlotNames(Object* argList, Object* bodyList, Environment& globalEnv);
+Object* resolveLambdaBody(Object* slotNames, Object* bodyList, Environment& globalEnv);
+
+}  // namespace scm
@@ -1,31 +1,22 @@
 #include "scheme.hpp"
+#include <algorithm>
 #include <iostream>
 
 namespace scm {
 
 // getter functions
-/**
- * Returns the ObjectTypeTag of an object.
- * @param obj the object from which to read the tag
- * @returns the tag of the object
- */
-ObjectTypeTag getTag(Object* obj)
-{
-  return obj->tag;
-}
-
 /**
  * Returns the string value of an object, if applicable.
  * @param obj the object from which to read the string value
  * @throw schemeException on invalid object
  * @returns the string value of the object
  */
-std::string getStringValue(Object* obj)
+const std::string& getStringValue(Object* obj)
 {
   if (!hasTag(obj, TAG_STRING) && !hasTag(obj, TAG_SYMBOL)) {
     schemeThrow("object has no string value that could be gotten");
   }
-  return std::get<std::string>(obj->value);
+  return static_cast<StringObject*>(obj)->value;
 }
 
 /**
@@ -39,7 +30,7 @@ int getIntValue(Object* obj)
   if (!hasTag(obj, TAG_INT)) {
     schemeThrow("object has no integer value that could be gotten");
   }
-  return std::get<int>(obj->value);
+  return fixnumValue(obj);
 }
 
 /**
@@ -53,7 +44,7 @@ double getFloatValue(Object* obj)
   if (!hasTag(obj, TAG_FLOAT)) {
     schemeThrow("object has no float value that could be gotten");
   }
-  return std::get<double>(obj->value);
+  return static_cast<FloatObject*>(obj)->value;
 }
 
 /**
@@ -62,12 +53,12 @@ double getFloatValue(Object* obj)
  * @throw schemeException on invalid object
  * @returns the cons value of the object
  */
-ConsValue getCons(Object* obj)
+const ConsValue& getCons(Object* obj)
 {
   if (!hasTag(obj, TAG_CONS)) {
     schemeThrow("tried to get consvalue from non-cons object: " + toString(obj));
   }
-  return std::get<ConsValue>(obj->value);
+  return static_cast<ConsObject*>(obj)->value;
 }
 
 /**
@@ -78,8 +69,7 @@ ConsValue getCons(Object* obj)
  */
 Object* getCar(Object* obj)
 {
-  auto cons{getCons(obj)};
-  return cons.car;
+  return getCons(obj).car;
 }
 
 /**
@@ -90,8 +80,35 @@ Object* getCar(Object* obj)
  */
 Object* getCdr(Object* obj)
 {
-  auto cons{getCons(obj)};
-  return cons.cdr;
+  return getCons(obj).cdr;
+}
+
+/**
+ * Count the elements of a list.
+ * @param list the list
+ * @returns the number of elements, -1 if the list isn't terminated by nil
+ */
+int listLength(Object* list)
+{
+  int length{0};
+  for (; hasTag(list, TAG_CONS); list = getCdr(list)) {
+    length++;
+  }
+  return getTag(list) == TAG_NIL ? length : -1;
+}
+
+/**
+ * Returns the description of a scheme function or syntax object
+ * @param obj the object from which to read the description
+ * @throw schemeException on non-syntax ort non-builtin-function
+ * @returns the entry of the builtin tables the object points to
+ */
+const BuiltinDescriptor& getBuiltinDescriptor(Object* obj)
+{
+  if (!isOneOf(obj, {TAG_FUNC_BUILTIN, TAG_SYNTAX})) {
+    schemeThrow("not a builtin function!");
+  }
+  return *static_cast<FuncObject*>(obj)->descriptor;
 }
 
 /**
@@ -102,24 +119,19 @@ Object* getCdr(Object* obj)
  */
 FunctionTag getBuiltinFuncTag(Object* obj)
 {
-  if (!isOneOf(obj, {TAG_FUNC_BUILTIN, TAG_SYNTAX})) {
-    schemeThrow("not a builtin function!");
-  }
-  return std::get<FuncValue>(obj->value).funcTag;
+  return getBuiltinDescriptor(obj).funcTag;
 }
 
 /**
  * Returns the name of a scheme function or syntax object
  * @param obj the object from which to read the name
  * @throw schemeException on non-syntax ort non-builtin-function
- * @returns the function name of the object
+ * @returns the function name of the object, prefixed by its kind
  */
 std::string getBuiltinFuncName(Object* obj)
 {
-  if (!isOneOf(obj, {TAG_FUNC_BUILTIN, TAG_SYNTAX})) {
-    schemeThrow("not a builtin function!");
-  }
-  return std::get<FuncValue>(obj->value).name;
+  const BuiltinDescriptor& descriptor{getBuiltinDescriptor(obj)};
+  return (hasTag(obj, TAG_SYNTAX) ? "syntax:" : "primitive:") + std::string{descriptor.name};
 }
 
 /**
@@ -130,10 +142,7 @@ std::string getBuiltinFuncName(Object* obj)
  */
 int getBuiltinFuncNArgs(Object* obj)
 {
-  if (!isOneOf(obj, {TAG_FUNC_BUILTIN, TAG_SYNTAX})) {
-    schemeThrow("not a builtin function!");
-  }
-  return std::get<FuncValue>(obj->value).nArgs;
+  return getBuiltinDescriptor(obj).nArgs;
 }
 
 /**
@@ -144,10 +153,7 @@ int getBuiltinFuncNArgs(Object* obj)
  */
 std::string getBuiltinFuncHelpText(Object* obj)
 {
-  if (!isOneOf(obj, {TAG_FUNC_BUILTIN, TAG_SYNTAX})) {
-    schemeThrow("not a builtin function!");
-  }
-  return std::get<FuncValue>(obj->value).helpText;
+  return getBuiltinDescriptor(obj).helpText;
 }
 
 /**
@@ -161,7 +167,7 @@ Object* getUserFunctionArgList(Object* obj)
   if (!hasTag(obj, TAG_FUNC_USER)) {
     schemeThrow("not a user function!");
   }
-  return std::get<UserFuncValue>(obj->value).argList;
+  return static_cast<UserFuncObject*>(obj)->value.argList;
 }
 
 /**
@@ -175,7 +181,7 @@ Object* getUserFunctionBodyList(Object* obj)
   if (!hasTag(obj, TAG_FUNC_USER)) {
     schemeThrow("not a user function!");
   }
-  return std::get<UserFuncValue>(obj->value).bodyList;
+  return static_cast<UserFuncObject*>(obj)->value.bodyList;
 }
 
 /**
@@ -189,7 +195,105 @@ Environment* getUserFunctionParentEnv(Object* obj)
   if (!hasTag(obj, TAG_FUNC_USER)) {
     schemeThrow("not a user function!");
   }
-  return std::get<UserFuncValue>(obj->value).env;
+  return static_cast<UserFuncObject*>(obj)->value.env;
+}
+
+/**
+ * Returns the names of the local variables of a user defined function.
+ * @param obj the user defined function object from which to get the names
+ * @throw schemeException if obj isn't a user defined function
+ * @returns a list of symbols, one per frame slot
+ */
+Object* getUserFunctionSlotNames(Object* obj)
+{
+  if (!hasTag(obj, TAG_FUNC_USER)) {
+    schemeThrow("not a user function!");
+  }
+  return static_cast<UserFuncObject*>(obj)->value.slotNames;
+}
+
+/**
+ * Returns the number of frame slots a call of a user defined function requires.
+ * @param obj the user defined function object from which to get the frame size
+ * @throw schemeException if obj isn't a user defined function
+ * @returns the number of local variables of the function
+ */
+int getUserFunctionFrameSize(Object* obj)
+{
+  if (!hasTag(obj, TAG_FUNC_USER)) {
+    schemeThrow("not a user function!");
+  }
+  return static_cast<UserFuncObject*>(obj)->value.frameSize;
+}
+
+/**
+ * Returns the compiled body of a user defined function.
+ * @param obj the user defined function object from which to get the code
+ * @throw schemeException if obj isn't a user defined function
+ * @returns the bytecode object, NULL if the function wasn't compiled yet
+ */
+Object* getUserFunctionCode(Object* obj)
+{
+  if (!hasTag(obj, TAG_FUNC_USER)) {
+    schemeThrow("not a user function!");
+  }
+  return static_cast<UserFuncObject*>(obj)->value.code;
+}
+
+/**
+ * Returns the frame address of a resolved local variable reference.
+ * @param obj the local reference object
+ * @throw schemeException if obj isn't a local reference
+ * @returns the symbol, depth and slot of the reference
+ */
+const LocalRefValue& getLocalRef(Object* obj)
+{
+  if (!hasTag(obj, TAG_LOCAL_REF)) {
+    schemeThrow("not a local variable reference!");
+  }
+  return static_cast<LocalRefObject*>(obj)->value;
+}
+
+/**
+ * Returns the symbol and current value of a top level variable cell.
+ * @param obj the global cell object
+ * @throw schemeException if obj isn't a global cell
+ * @returns a reference to the cell, so its value can be updated in place
+ */
+GlobalCellValue& getGlobalCell(Object* obj)
+{
+  if (!hasTag(obj, TAG_GLOBAL_CELL)) {
+    schemeThrow("not a global variable cell!");
+  }
+  return static_cast<GlobalCellObject*>(obj)->value;
+}
+
+/**
+ * Returns the instructions and constants of a piece of compiled code.
+ * @param obj the bytecode object
+ * @throw schemeException if obj isn't bytecode
+ * @returns a reference to the code
+ */
+BytecodeValue& getBytecode(Object* obj)
+{
+  if (!hasTag(obj, TAG_BYTECODE)) {
+    schemeThrow("not a bytecode object!");
+  }
+  return static_cast<BytecodeObject*>(obj)->value;
+}
+
+/**
+ * Returns the syntax and the parts of an analyzed syntax form.
+ * @param obj the special form object
+ * @throw schemeException if obj isn't a special form
+ * @returns the syntax and the parts of the form
+ */
+const SpecialFormValue& getSpecialForm(Object* obj)
+{
+  if (!hasTag(obj, TAG_SPECIAL_FORM)) {
+    schemeThrow("not a special form!");
+  }
+  return static_cast<SpecialFormObject*>(obj)->value;
 }
 
 // Bool operations
@@ -235,13 +339,15 @@ bool hasTag(Object* obj, ObjectTypeTag tag)
 
 /**
  * Does the object is one of a list of types
+ * The types are passed as an initializer list, so checking doesn't allocate.
  * @param obj the object to be checked
+ * @param validTypes the accepted types
  * @returns true if the has the same tag, false otherwise
  */
-bool isOneOf(Object* obj, std::vector<ObjectTypeTag> validTypes)
+bool isOneOf(Object* obj, std::initializer_list<ObjectTypeTag> validTypes)
 {
-  auto lambda = [obj](ObjectTypeTag tag) { return hasTag(obj, tag); };
-  return std::any_of(validTypes.begin(), validTypes.end(), lambda);
+  ObjectTypeTag tag{getTag(obj)};
+  return std::find(validTypes.begin(), validTypes.end(), tag) != validTypes.end();
 }
 
 // other helper functions
@@ -290,6 +396,21 @@ std::string tagToString(ObjectTypeTag tag)
     case TAG_VOID:
       return "void";
       break;
+    case TAG_LOCAL_REF:
+      return "local variable";
+      break;
+    case TAG_GLOBAL_CELL:
+      return "global variable";
+      break;
+    case TAG_BYTECODE:
+      return "bytecode";
+      break;
+    case TAG_SPECIAL_FORM:
+      return "special form";
+      break;
+    case TAG_ENVIRONMENT:
+      return "environment";
+      break;
     default:
       return "unrecognized name";
   };
@@ -309,7 +430,7 @@ static std::string consToString(scm::Object* cons, std::string& str)
   if (hasTag(cdr, TAG_CONS)) {
     return consToString(cdr, str);
   }
-  else if (cdr->tag == TAG_NIL) {
+  else if (getTag(cdr) == TAG_NIL) {
     return str + ")";
   }
   else {
@@ -317,6 +438,37 @@ static std::string consToString(scm::Object* cons, std::string& str)
   }
 }
 
+/**
+ * Returns a readable representation of an analyzed syntax form, only to be used by toString.
+ * It's written like the expression the form was analyzed from.
+ * @param form the special form object to represent
+ * @returns the string representation of the object
+ */
+static std::string specialFormToString(Object* form)
+{
+  const SpecialFormValue& value{getSpecialForm(form)};
+  std::string str;
+  switch (value.syntax) {
+    case SYNTAX_QUOTE:
+      return "( quote " + toString(value.first) + " )";
+    case SYNTAX_IF:
+      return "( if " + toString(value.first) + " " + toString(value.second) + " " +
+             toString(value.third) + " )";
+    case SYNTAX_DEFINE:
+      return "( define " + toString(value.first) + " " + toString(value.second) + " )";
+    case SYNTAX_SET:
+      return "( set! " + toString(value.first) + " " + toString(value.second) + " )";
+    case SYNTAX_BEGIN:
+      str = "( begin ";
+      return consToString(value.first, str);
+    case SYNTAX_LAMBDA:
+      str = "( lambda " + toString(value.first) + " ";
+      return hasTag(value.second, TAG_CONS) ? consToString(value.second, str) : str + ")";
+    default:
+      return "#<special form " + std::to_string(value.syntax) + '>';
+  }
+}
+
 /**
  * Returns a readable representation of an object.
  * @param tag the object to represent
@@ -325,18 +477,18 @@ static std::string consToString(scm::Object* cons, std::string& str)
 std::string toString(Object* obj)
 {
   std::string consStart;
-  switch (obj->tag) {
+  switch (getTag(obj)) {
     case TAG_INT:
-      return std::to_string(std::get<int>(obj->value));
+      return std::to_string(fixnumValue(obj));
       break;
     case TAG_FLOAT:
-      return std::to_string(std::get<double>(obj->value));
+      return std::to_string(static_cast<FloatObject*>(obj)->value);
       break;
     case TAG_STRING:
-      return '"' + std::get<std::string>(obj->value) + '"';
+      return '"' + static_cast<StringObject*>(obj)->value + '"';
       break;
     case TAG_SYMBOL:
-      return std::get<std::string>(obj->value);
+      return static_cast<StringObject*>(obj)->value;
       break;
     case TAG_NIL:
       return "()";
@@ -361,10 +513,18 @@ std::string toString(Object* obj)
       return "#<" + getBuiltinFuncName(obj) + '>';
     case TAG_EOF:
       return "finished";
+    case TAG_LOCAL_REF:
+      return getStringValue(getLocalRef(obj).symbol);
+    case TAG_GLOBAL_CELL:
+      return getStringValue(getGlobalCell(obj).symbol);
+    case TAG_BYTECODE:
+      return "#<bytecode " + std::to_string(getBytecode(obj).instructions.size()) + '>';
+    case TAG_SPECIAL_FORM:
+      return specialFormToString(obj);
     case TAG_VOID:
       return "V̱̲̠̹̪́ͨ̇̄̏ͤ́̊͌Ơ̶̸̖̮̙̘̻̘͇̘ͭ͋͛̾̇Į̶̯ͦ̃́̅͗D̵͔̯̰̞͔̖̞̣͌ͪ̓ͨ͋";
     default:
-      return "{{TO STRING NOT YET IMPLEMENTED FOR TAG " + std::to_string(obj->tag) + "}}";
+      return "{{TO STRING NOT YET IMPLEMENTED FOR TAG " + std::to_string(getTag(obj)) + "}}";
       break;
   }
 }
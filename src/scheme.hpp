@@ -1,11 +1,14 @@
 #pragma once
+#include <cstdint>
 #include <exception>
+#include <initializer_list>
 #include <iostream>
 #include <regex>
 #include <sstream>
 #include <stack>
 #include <string>
 #include <variant>
+#include <vector>
 #include "garbage_collection.hpp"
 
 namespace scm {
@@ -13,7 +16,7 @@ namespace scm {
 /**
  * The types our objects can be
  */
-enum ObjectTypeTag {
+enum ObjectTypeTag : int {
   TAG_INT = 1,
   TAG_FLOAT,
   TAG_STRING,
@@ -27,6 +30,12 @@ enum ObjectTypeTag {
   TAG_SYNTAX,
   TAG_VOID,
   TAG_EOF,
+  TAG_LOCAL_REF,
+  TAG_GLOBAL_CELL,
+  TAG_BYTECODE,
+  TAG_SPECIAL_FORM,
+  // not an Object, environments share the heap and the collectable header with objects
+  TAG_ENVIRONMENT,
 };
 
 /**
@@ -63,43 +72,281 @@ enum FunctionTag {
   FUNC_IS_FUNC,
   FUNC_IS_USERFUNC,
   FUNC_IS_BOOL,
+  FUNC_GC_STATS,
+  FUNC_HEAP_CENSUS,
 };
 
 // forward declarations required for Object Class
 struct Object;
 class Environment;
 
+// what this is supposed to do: *function -> *function
+// this is used in our trampoline (see evaluation.cpp)
+// VoidoPtrFunc is a function returning a void pointer
+using VoidPtrFunc = void*();
+// Continuation is a function returning a pointer to a function
+using Continuation = VoidPtrFunc*();
+
+// in theory, this should do the same thing as above
+// but it doesn't. why? If you know why please let me know :)
+// using VoidPtrFunc = std::function<void*()>;
+// using Continuation = std::function<VoidPtrFunc*()>;
+
 // a Cons consists of at least one element and element after that
 struct ConsValue {
   Object* car;
   Object* cdr;
 };
-// the value of a builtin function or syntax
-struct FuncValue {
-  std::string name;
+// the description of a builtin function or syntax, builtin objects point into the tables of
+// setup.cpp
+struct BuiltinDescriptor {
+  const char* name;
+  // the number of arguments, -1 for any number
   int nArgs;
   FunctionTag funcTag;
-  std::string helpText;
+  // the continuation doing the actual work, called with the arity checked already
+  Continuation* (*entry)();
+  // a shortcut for two integer or two float arguments, NULL if there's none. It returns NULL
+  // for any other arguments, which are left to entry then
+  Object* (*binaryFastPath)(Object* a, Object* b);
+  const char* helpText;
+  // the result only depends on the arguments and the call has no side effects
+  bool isPure;
 };
 // the value of a user defined function
 struct UserFuncValue {
   Object* argList;
   Object* bodyList;
   Environment* env;
+  // the names of all local variables, arguments first, in the order of their frame slots
+  Object* slotNames;
+  int frameSize;
+  // the compiled body, NULL until the function is created or first called by the virtual machine
+  Object* code;
+};
+// a variable reference that was resolved to a slot of a frame when its lambda was created
+struct LocalRefValue {
+  Object* symbol;
+  // how many frames to go up from the current one
+  int depth;
+  // the index of the variable within that frame
+  int slot;
+};
+// the value cell of a top level variable, its address stays the same for the lifetime of the
+// variable so resolved lambda bodies can refer to it directly
+struct GlobalCellValue {
+  Object* symbol;
+  // NULL while the variable is referenced but not yet defined
+  Object* value;
+};
+// a syntax form of a lambda body whose shape was checked when the lambda was created, so it's
+// evaluated without looking up its syntax or walking its arguments, see resolve.cpp
+struct SpecialFormValue {
+  // quote, if, define, set!, begin or lambda
+  FunctionTag syntax;
+  // quote: the quoted object
+  // if: the condition, the consequent and the alternative
+  // define and set!: the target and the value expression
+  // begin: the list of expressions
+  // lambda: the argument list, the body list and the slot names
+  Object* first;
+  Object* second;
+  Object* third;
+};
+
+/**
+ * The instructions of the virtual machine, see vm.cpp. Values are pushed onto and popped from
+ * the value stack of the trampoline.
+ */
+enum OpCode : int {
+  // push the constant with the index operand
+  OP_CONSTANT,
+  // push the slot operand of the current frame
+  OP_LOCAL,
+  // push the variable the local reference constant operand points to
+  OP_OUTER_LOCAL,
+  // push the value of the global cell constant operand
+  OP_GLOBAL,
+  // push the variable named by the symbol constant operand, looked up by name
+  OP_VARIABLE,
+  // pop a value and define the symbol or local reference constant operand as it, push void
+  OP_DEFINE,
+  // set! the variable constant operand to the topmost value, which stays on the stack
+  OP_SET,
+  // push a new function made of the bytecode constant operand and the current frame
+  OP_CLOSURE,
+  // drop the topmost value
+  OP_POP,
+  // continue with the instruction at index operand
+  OP_JUMP,
+  // pop a value, continue with the instruction at index operand if it's false
+  OP_JUMP_IF_FALSE,
+  // call the function below the topmost operand values with those as its arguments
+  OP_CALL,
+  // same as OP_CALL, but the call replaces the current one
+  OP_TAIL_CALL,
+  // hand the topmost value back to the caller
+  OP_RETURN,
+  // evaluate the expression constant operand with the trampoline, for everything not compiled
+  OP_EVALUATE,
+};
+
+struct Instruction {
+  OpCode op;
+  int operand;
+};
+
+// the compiled body of a lambda or a compiled top level expression
+struct BytecodeValue {
+  std::vector<Instruction> instructions;
+  // the objects the instructions refer to by index
+  std::vector<Object*> constants;
+  // the lambda the code was compiled from, all NULL for a top level expression
+  Object* argList;
+  Object* bodyList;
+  Object* slotNames;
+  // the number of arguments a call has to pass at least
+  int nArgs;
 };
 
 /**
  * The base class of every scheme object we use.
- * Central point of this interpreter
+ * Central point of this interpreter. An Object only consists of the header, each type has its
+ * own layout below which adds the value. Use the getter functions to access these values.
  */
 struct Object : public Collectable {
-  ObjectTypeTag tag;
-  // can hold multiple different values
-  std::variant<int, double, std::string, ConsValue, FuncValue, UserFuncValue> value;
-  Object(ObjectTypeTag tag) : tag(tag){};
-  ~Object(){};
+  Object(ObjectTypeTag tag) : Collectable(tag){};
+};
+
+// the layouts of the individual object types
+struct FloatObject : public Object {
+  double value;
+  FloatObject(double value) : Object(TAG_FLOAT), value(value){};
+};
+// used for both strings and symbols
+struct StringObject : public Object {
+  std::string value;
+  StringObject(ObjectTypeTag tag, std::string value) : Object(tag), value(std::move(value)){};
+};
+struct ConsObject : public Object {
+  ConsValue value;
+  ConsObject(Object* car, Object* cdr) : Object(TAG_CONS), value{car, cdr} {};
+};
+// used for both builtin functions and syntax
+struct FuncObject : public Object {
+  const BuiltinDescriptor* descriptor;
+  FuncObject(ObjectTypeTag tag, const BuiltinDescriptor* descriptor)
+      : Object(tag), descriptor(descriptor){};
+};
+struct UserFuncObject : public Object {
+  UserFuncValue value;
+  UserFuncObject(UserFuncValue value) : Object(TAG_FUNC_USER), value(value){};
+};
+struct LocalRefObject : public Object {
+  LocalRefValue value;
+  LocalRefObject(LocalRefValue value) : Object(TAG_LOCAL_REF), value(value){};
+};
+struct GlobalCellObject : public Object {
+  GlobalCellValue value;
+  GlobalCellObject(GlobalCellValue value) : Object(TAG_GLOBAL_CELL), value(value){};
+};
+struct BytecodeObject : public Object {
+  BytecodeValue value;
+  BytecodeObject(BytecodeValue value) : Object(TAG_BYTECODE), value(std::move(value)){};
+};
+struct SpecialFormObject : public Object {
+  SpecialFormValue value;
+  SpecialFormObject(SpecialFormValue value) : Object(TAG_SPECIAL_FORM), value(value){};
 };
 
+// the header of every heap object is a single word, a cons is a header plus car and cdr
+static_assert(sizeof(Object) <= sizeof(std::uint64_t), "object header exceeds one word");
+static_assert(sizeof(ConsObject) == sizeof(Object) + 2 * sizeof(Object*), "cons has padding");
+
+/**
+ * Tagged value representation.
+ * An Object* is treated as a machine word rather than always being a real pointer. Heap objects
+ * are at least 4-byte aligned, so the lowest bits of a real pointer are always zero. We use those
+ * bits to store small values directly in the word, which means they never touch the heap:
+ *   ...xx1  fixnum, the integer value is stored in the remaining upper bits
+ *   ...x10  immediate singleton (nil, #t, #f, void, eof), its tag is stored in the upper bits
+ *   ...x00  pointer to a heap allocated Object
+ * Never dereference an Object* without checking isHeapObject first, use getTag instead of ->tag.
+ */
+constexpr std::uintptr_t FIXNUM_BIT{0b01};
+constexpr std::uintptr_t IMMEDIATE_MASK{0b11};
+constexpr std::uintptr_t IMMEDIATE_BITS{0b10};
+constexpr int IMMEDIATE_SHIFT{2};
+
+/**
+ * Is the passed value a real pointer to an object on the heap?
+ * @param obj the value to be checked
+ * @returns true if the value may be dereferenced, false for fixnums and immediates
+ */
+inline bool isHeapObject(Object* obj)
+{
+  return (reinterpret_cast<std::uintptr_t>(obj) & IMMEDIATE_MASK) == 0;
+}
+
+/**
+ * Is the passed value an integer that's encoded in the value word itself?
+ * @param obj the value to be checked
+ * @returns true if the value is a fixnum
+ */
+inline bool isFixnum(Object* obj)
+{
+  return (reinterpret_cast<std::uintptr_t>(obj) & FIXNUM_BIT) != 0;
+}
+
+/**
+ * Encode an integer in a value word, no allocation takes place.
+ * @param value the integer to encode
+ * @returns the tagged value word
+ */
+inline Object* makeFixnum(int value)
+{
+  auto word{static_cast<std::uintptr_t>(static_cast<std::intptr_t>(value))};
+  return reinterpret_cast<Object*>((word << 1) | FIXNUM_BIT);
+}
+
+/**
+ * Decode the integer stored in a fixnum value word.
+ * @param obj the fixnum to decode
+ * @returns the integer value
+ */
+inline int fixnumValue(Object* obj)
+{
+  return static_cast<int>(reinterpret_cast<std::intptr_t>(obj) >> 1);
+}
+
+/**
+ * Encode a singleton tag (nil, #t, #f, void, eof) in a value word.
+ * @param tag the tag of the singleton
+ * @returns the tagged value word
+ */
+inline Object* makeImmediate(ObjectTypeTag tag)
+{
+  auto word{static_cast<std::uintptr_t>(tag)};
+  return reinterpret_cast<Object*>((word << IMMEDIATE_SHIFT) | IMMEDIATE_BITS);
+}
+
+/**
+ * Returns the ObjectTypeTag of an object, works for tagged values as well as heap objects.
+ * @param obj the object from which to read the tag
+ * @returns the tag of the object
+ */
+inline ObjectTypeTag getTag(Object* obj)
+{
+  auto word{reinterpret_cast<std::uintptr_t>(obj)};
+  if (word & FIXNUM_BIT) {
+    return TAG_INT;
+  }
+  if (word & IMMEDIATE_BITS) {
+    return static_cast<ObjectTypeTag>(word >> IMMEDIATE_SHIFT);
+  }
+  return obj->tag;
+}
+
 /**
  * A custom exception thrown when something goes wrong with our interpreter.
  */
@@ -132,13 +379,14 @@ class schemeException : public std::runtime_error {
 #define schemeThrow(arg) throw schemeException(arg, __FILE__, __LINE__);
 
 // Forward Declarations
-ObjectTypeTag getTag(Object* obj);
-std::string getStringValue(Object* obj);
+const std::string& getStringValue(Object* obj);
 int getIntValue(Object* obj);
 double getFloatValue(Object* obj);
-ConsValue getCons(Object* obj);
+const ConsValue& getCons(Object* obj);
 Object* getCar(Object* obj);
 Object* getCdr(Object* obj);
+int listLength(Object* list);
+const BuiltinDescriptor& getBuiltinDescriptor(Object* obj);
 FunctionTag getBuiltinFuncTag(Object* obj);
 std::string getBuiltinFuncName(Object* obj);
 int getBuiltinFuncNArgs(Object* obj);
@@ -147,11 +395,18 @@ Object* getUserFunctionBodyList(Object* obj);
 Object* getUserFunctionArgList(Object* obj);
 std::string getBuiltinFuncHelpText(Object* obj);
 Environment* getUserFunctionParentEnv(Object* obj);
+Object* getUserFunctionSlotNames(Object* obj);
+int getUserFunctionFrameSize(Object* obj);
+Object* getUserFunctionCode(Object* obj);
+const LocalRefValue& getLocalRef(Object* obj);
+GlobalCellValue& getGlobalCell(Object* obj);
+BytecodeValue& getBytecode(Object* obj);
+const SpecialFormValue& getSpecialForm(Object* obj);
 bool hasTag(Object* obj, ObjectTypeTag tag);
 bool isString(Object* obj);
 bool isNumeric(Object* obj);
 bool isFloatingPoint(Object* obj);
-bool isOneOf(Object* obj, std::vector<ObjectTypeTag> validTypes);
+bool isOneOf(Object* obj, std::initializer_list<ObjectTypeTag> validTypes);
 std::string tagToString(ObjectTypeTag tag);
 std::string toString(scm::Object* obj);
 static std::string consToString(scm::Object* cons, std::string& str);
@@ -159,21 +414,9 @@ std::string prettifyUserFunction(Object* func);
 
 // Macros and Typedefs
 
-// what this is supposed to do: *function -> *function
-// this is used in our trampoline (see evaluation.cpp)
-// VoidoPtrFunc is a function returning a void pointer
-using VoidPtrFunc = void*();
-// Continuation is a function returning a pointer to a function
-using Continuation = VoidPtrFunc*();
-
-// in theory, this should do the same thing as above
-// but it doesn't. why? If you know why please let me know :)
-// using VoidPtrFunc = std::function<void*()>;
-// using Continuation = std::function<VoidPtrFunc*()>;
-
 using ObjectVec = std::vector<Object*>;
 using ObjectStack = std::stack<Object*>;
-using FunctionStack = std::stack<Continuation*>;
+using FunctionStack = std::stack<Continuation*, std::vector<Continuation*>>;
 
 // logging activation
 extern bool LOG_GARBAGE_COLLECTION;
@@ -3,177 +3,319 @@
 #include <loguru.hpp>
 #include "environment.hpp"
 #include "memory.hpp"
+#include "operations.hpp"
 #include "scheme.hpp"
 
 namespace scm {
 
 /**
- * Define a new builtin syntax object in an environment
- * @param env the environment in which to define the syntax
- * @param name the name of the syntax
- * @param nArgs the number of arguments required by the syntax, specify -1 for 0-inf arguments
- * @param tag the tag of the function for identification purposes
- * @param helpText a text that's shown when help is requested for this syntax
+ * The builtin syntax elements. Syntax gets its arguments unevaluated, so none of it is pure.
  */
-void defineNewSyntax(Environment& env,
-                     std::string name,
-                     int nArgs,
-                     FunctionTag tag,
-                     std::string helpText)
-{
-  Object* func{newSyntax(name, nArgs, tag, helpText)};
-  define(env, name, func);
-}
-
-/**
- * Define a new builtin function object in an environment
- * @param env the environment in which to define the function
- * @param name the name of the function
- * @param nArgs the number of arguments required by the function, specify -1 for 0-inf arguments
- * @param tag the tag of the function for identification purposes
- * @param helpText a text that's shown when help is requested for this function
- */
-void defineNewBuiltinFunction(Environment& env,
-                              std::string name,
-                              int nArgs,
-                              FunctionTag tag,
-                              std::string helpText)
-{
-  Object* func{newBuiltinFunction(name, nArgs, tag, helpText)};
-  define(env, name, func);
-}
-
-/**
- * Setup an environment with all builtin functions and syntax.
- * @param env the environment in which to define the operations
- */
-void setupEnvironment(Environment& env)
-{
-  std::string helpText{};
-  // setup syntax
-  helpText =
-      "returns the first argument:\n\
+static const BuiltinDescriptor syntaxDescriptors[]{
+    {"quote",
+     -1,
+     SYNTAX_QUOTE,
+     trampoline::quoteSyntax,
+     NULL,
+     "returns the first argument:\n\
   (quote 1 2 3) -> 1\n\
   (quote (1 2 3)) -> (1 2 3)\n\
-  shorthand: '(1 2 3)";
-  defineNewSyntax(env, "quote", -1, SYNTAX_QUOTE, helpText);
-  helpText =
-      "returns the first expression if the condition is true, the second otherwise:\n\
+  shorthand: '(1 2 3)",
+     false},
+    {"if",
+     -1,
+     SYNTAX_IF,
+     trampoline::ifSyntax,
+     NULL,
+     "returns the first expression if the condition is true, the second otherwise:\n\
   (if #t 1 2) -> 1\n\
-  (if #f 1 2) -> 2";
-  defineNewSyntax(env, "if", -1, SYNTAX_IF, helpText);
-  helpText =
-      "defines a value to the given variable name\n\
+  (if #f 1 2) -> 2",
+     false},
+    {"define",
+     -1,
+     SYNTAX_DEFINE,
+     trampoline::defineSyntax,
+     NULL,
+     "defines a value to the given variable name\n\
   (define a 10) -> a := 10\n\
   can be used in shorthand form for lambda definition\n\
-  (define (plus1 x) (+ x 1)";
-  defineNewSyntax(env, "define", -1, SYNTAX_DEFINE, helpText);
-  helpText =
-      "defines a value to the given variable name in all environments\n\
-  (set! a 10) -> a := 10";
-  defineNewSyntax(env, "set!", -1, SYNTAX_SET, helpText);
-  helpText =
-      "defines a new function\n\
+  (define (plus1 x) (+ x 1)",
+     false},
+    {"set!",
+     -1,
+     SYNTAX_SET,
+     trampoline::setSyntax,
+     NULL,
+     "defines a value to the given variable name in all environments\n\
+  (set! a 10) -> a := 10",
+     false},
+    {"lambda",
+     -1,
+     SYNTAX_LAMBDA,
+     trampoline::lambdaSyntax,
+     NULL,
+     "defines a new function\n\
   (lambda (arg1 arg2) (+ arg1 arg2)\n\
-  use in combination with define";
-  defineNewSyntax(env, "lambda", -1, SYNTAX_LAMBDA, helpText);
-  helpText =
-      "evaluate multiple expressions and return last result\n\
-  (begin (+ 1 1) (+ 2 2)) -> 4";
-  defineNewSyntax(env, "begin", -1, SYNTAX_BEGIN, helpText);
-  helpText =
-      "show help text for a given element\n\
+  use in combination with define",
+     false},
+    {"begin",
+     -1,
+     SYNTAX_BEGIN,
+     trampoline::beginSyntax,
+     NULL,
+     "evaluate multiple expressions and return last result\n\
+  (begin (+ 1 1) (+ 2 2)) -> 4",
+     false},
+    {"help",
+     0,
+     SYNTAX_HELP,
+     trampoline::helpSyntax,
+     NULL,
+     "show help text for a given element\n\
   help -> shows all defined variables, functions and syntax elements\n\
-  (help fname) -> shows a help text for the given function";
-  defineNewSyntax(env, "help", 0, SYNTAX_HELP, helpText);
+  (help fname) -> shows a help text for the given function",
+     false},
+};
 
-  // setup builtin functions
-  helpText =
-      "adds multiple numbers and/or strings\n\
+/**
+ * The builtin functions. Adding a row is all it takes to add a function, its entry finds the
+ * arguments on the value stack.
+ */
+static const BuiltinDescriptor builtinFunctionDescriptors[]{
+    {"+",
+     -1,
+     FUNC_ADD,
+     trampoline::addFunction,
+     trampoline::addFastPath,
+     "adds multiple numbers and/or strings\n\
   (+ 1 2 3) -> 6\n\
   (+ 1 2 2.5) -> 5.5\n\
   (+ \"hello \" \"world!\") -> \"hello world!\"\n\
   (+ \"hello \" 1 \" world!\") -> \"hello 1 world!\"\n\
-  priority: string > float > integer";
-  defineNewBuiltinFunction(env, "+", -1, FUNC_ADD, helpText);
-  helpText =
-      "subtracts the sum of multiple numbers from the first argument\n\
+  priority: string > float > integer",
+     true},
+    {"-",
+     -1,
+     FUNC_SUB,
+     trampoline::subFunction,
+     trampoline::subFastPath,
+     "subtracts the sum of multiple numbers from the first argument\n\
   (- 1 2 3) -> 4\n\
-  (- 1 2 2.5) -> 3.5";
-  defineNewBuiltinFunction(env, "-", -1, FUNC_SUB, helpText);
-  helpText =
-      "multiplies all arguments with each other\n\
-  (* 2 2 2) -> 8";
-  defineNewBuiltinFunction(env, "*", -1, FUNC_MULT, helpText);
-  helpText =
-      "divides the first argument by the product of all other arguments\n\
-  (/ 2 2 2) -> 0.5";
-  defineNewBuiltinFunction(env, "/", -1, FUNC_DIV, helpText);
-  helpText =
-      "returns true if same exact object\n\
-  (eq? 1 1) -> #f\n\
-  (eq? a a) -> #t";
-  defineNewBuiltinFunction(env, "eq?", 2, FUNC_EQ, helpText);
-  helpText =
-      "returns true if the passed strings are identical\n\
+  (- 1 2 2.5) -> 3.5",
+     true},
+    {"*",
+     -1,
+     FUNC_MULT,
+     trampoline::multFunction,
+     trampoline::multFastPath,
+     "multiplies all arguments with each other\n\
+  (* 2 2 2) -> 8",
+     true},
+    {"/",
+     -1,
+     FUNC_DIV,
+     trampoline::divFunction,
+     NULL,
+     "divides the first argument by the product of all other arguments\n\
+  (/ 2 2 2) -> 0.5",
+     true},
+    {"eq?",
+     2,
+     FUNC_EQ,
+     trampoline::eqFunction,
+     NULL,
+     "returns true if same exact object\n\
+  (eq? 1.5 1.5) -> #f\n\
+  (eq? a a) -> #t",
+     true},
+    {"equal-string?",
+     2,
+     FUNC_EQUAL_STRING,
+     trampoline::equalStringFunction,
+     NULL,
+     "returns true if the passed strings are identical\n\
   (equal-string? \"asd\" \"asd\") -> #t\n\
-  (equal-string? \"asd\" \"qwe\") -> #f";
-  defineNewBuiltinFunction(env, "equal-string?", 2, FUNC_EQUAL_STRING, helpText);
-  helpText =
-      "returns true if the passed numbers are equal\n\
+  (equal-string? \"asd\" \"qwe\") -> #f",
+     true},
+    {"=",
+     2,
+     FUNC_EQUAL_NUMBER,
+     trampoline::equalNumberFunction,
+     trampoline::equalNumberFastPath,
+     "returns true if the passed numbers are equal\n\
   (= 1 1) -> #t\n\
   (= 1 2) -> #f\n\
-  (= 1 1.0) -> #t";
-  defineNewBuiltinFunction(env, "=", 2, FUNC_EQUAL_NUMBER, helpText);
-  helpText =
-      "returns true if the first numbers is greater than the latter\n\
+  (= 1 1.0) -> #t",
+     true},
+    {">",
+     2,
+     FUNC_GT,
+     trampoline::greaterThanFunction,
+     trampoline::greaterThanFastPath,
+     "returns true if the first numbers is greater than the latter\n\
   (> 1 1) -> #f\n\
   (> 3 2) -> #t\n\
-  (> 0 1.0) -> #f";
-  defineNewBuiltinFunction(env, ">", 2, FUNC_GT, helpText);
-  helpText =
-      "returns true if the first numbers is lesser than the latter\n\
+  (> 0 1.0) -> #f",
+     true},
+    {"<",
+     2,
+     FUNC_LT,
+     trampoline::lesserThanFunction,
+     trampoline::lesserThanFastPath,
+     "returns true if the first numbers is lesser than the latter\n\
   (< 1 1) -> #f\n\
   (< 3 2) -> #f\n\
-  (< 0 1.0) -> #t";
-  defineNewBuiltinFunction(env, "<", 2, FUNC_LT, helpText);
-  helpText =
-      "assembles a new cons object\n\
+  (< 0 1.0) -> #t",
+     true},
+    {"cons",
+     2,
+     FUNC_CONS,
+     trampoline::consFunction,
+     NULL,
+     "assembles a new cons object\n\
   (cons 1 2) -> (1 . 2)\n\
-  (cons 1 '(2 3)) -> (1 2 3)";
-  defineNewBuiltinFunction(env, "cons", 2, FUNC_CONS, helpText);
-  helpText =
-      "get the car of a cons\n\
-  (car '(1 2 3)) -> 1";
-  defineNewBuiltinFunction(env, "car", 1, FUNC_CAR, helpText);
-  helpText =
-      "get the cdr of a cons\n\
-  (cdr '(1 2 3)) -> (2 3)";
-  defineNewBuiltinFunction(env, "cdr", 1, FUNC_CDR, helpText);
-  helpText =
-      "assembles a list with the given arguments\n\
-  (list 1 2 3) -> (1 2 3)";
-  defineNewBuiltinFunction(env, "list", -1, FUNC_LIST, helpText);
-  helpText =
-      "displays the passed argument, best used within functions\n\
-  (display 1 2 3) -> returns void, prints (1 2 3)";
-  defineNewBuiltinFunction(env, "display", -1, FUNC_DISPLAY, helpText);
-  helpText = "returns the function body of a given lambda";
-  defineNewBuiltinFunction(env, "function-body", 1, FUNC_FUNCTION_BODY, helpText);
-  helpText = "returns the function argument list of a given lambda";
-  defineNewBuiltinFunction(env, "function-arglist", 1, FUNC_FUNCTION_ARGLIST, helpText);
-  helpText = "returns true if the argument is a string";
-  defineNewBuiltinFunction(env, "string?", 1, FUNC_IS_STRING, helpText);
-  helpText = "returns true if the argument is an integer or a float value";
-  defineNewBuiltinFunction(env, "number?", 1, FUNC_IS_NUMBER, helpText);
-  helpText = "returns true if the argument is a cons object";
-  defineNewBuiltinFunction(env, "cons?", 1, FUNC_IS_CONS, helpText);
-  helpText = "returns true if the argument is a builtin function";
-  defineNewBuiltinFunction(env, "function?", 1, FUNC_IS_FUNC, helpText);
-  helpText = "returns true if the argument is a user defined function";
-  defineNewBuiltinFunction(env, "user-function?", 1, FUNC_IS_USERFUNC, helpText);
-  helpText = "returns true if the argument is real bool value";
-  defineNewBuiltinFunction(env, "bool?", 1, FUNC_IS_BOOL, helpText);
+  (cons 1 '(2 3)) -> (1 2 3)",
+     false},
+    {"car",
+     1,
+     FUNC_CAR,
+     trampoline::carFunction,
+     NULL,
+     "get the car of a cons\n\
+  (car '(1 2 3)) -> 1",
+     true},
+    {"cdr",
+     1,
+     FUNC_CDR,
+     trampoline::cdrFunction,
+     NULL,
+     "get the cdr of a cons\n\
+  (cdr '(1 2 3)) -> (2 3)",
+     true},
+    {"list",
+     -1,
+     FUNC_LIST,
+     trampoline::listFunction,
+     NULL,
+     "assembles a list with the given arguments\n\
+  (list 1 2 3) -> (1 2 3)",
+     false},
+    {"display",
+     -1,
+     FUNC_DISPLAY,
+     trampoline::displayFunction,
+     NULL,
+     "displays the passed argument, best used within functions\n\
+  (display 1 2 3) -> returns void, prints (1 2 3)",
+     false},
+    {"function-body",
+     1,
+     FUNC_FUNCTION_BODY,
+     trampoline::functionBodyFunction,
+     NULL,
+     "returns the function body of a given lambda",
+     true},
+    {"function-arglist",
+     1,
+     FUNC_FUNCTION_ARGLIST,
+     trampoline::functionArglistFunction,
+     NULL,
+     "returns the function argument list of a given lambda",
+     true},
+    {"string?",
+     1,
+     FUNC_IS_STRING,
+     trampoline::isStringFunction,
+     NULL,
+     "returns true if the argument is a string",
+     true},
+    {"number?",
+     1,
+     FUNC_IS_NUMBER,
+     trampoline::isNumberFunction,
+     NULL,
+     "returns true if the argument is an integer or a float value",
+     true},
+    {"cons?",
+     1,
+     FUNC_IS_CONS,
+     trampoline::isConsFunction,
+     NULL,
+     "returns true if the argument is a cons object",
+     true},
+    {"function?",
+     1,
+     FUNC_IS_FUNC,
+     trampoline::isBuiltinFunctionFunction,
+     NULL,
+     "returns true if the argument is a builtin function",
+     true},
+    {"user-function?",
+     1,
+     FUNC_IS_USERFUNC,
+     trampoline::isUserFunctionFunction,
+     NULL,
+     "returns true if the argument is a user defined function",
+     true},
+    {"bool?",
+     1,
+     FUNC_IS_BOOL,
+     trampoline::isBoolFunction,
+     NULL,
+     "returns true if the argument is real bool value",
+     true},
+    {"gc-stats",
+     0,
+     FUNC_GC_STATS,
+     trampoline::gcStatsFunction,
+     NULL,
+     "returns statistics of the garbage collector as an association list\n\
+  (gc-stats) -> ((full-collections . 3) (young-collections . 12) (slices . 0) ...)",
+     false},
+    {"heap-census",
+     0,
+     FUNC_HEAP_CENSUS,
+     trampoline::heapCensusFunction,
+     NULL,
+     "returns the number of objects and bytes on the heap per type\n\
+  (heap-census) -> ((float 2 32) (string 5 160) (symbol 310 9920) ...)",
+     false},
+};
+
+/**
+ * Define a new builtin syntax object in an environment
+ * @param env the environment in which to define the syntax
+ * @param descriptor the name, arity, code and help text of the syntax, must outlive the object
+ */
+void defineNewSyntax(Environment& env, const BuiltinDescriptor& descriptor)
+{
+  Object* func{newSyntax(descriptor)};
+  define(env, newSymbol(descriptor.name), func);
+}
+
+/**
+ * Define a new builtin function object in an environment
+ * @param env the environment in which to define the function
+ * @param descriptor the name, arity, code and help text of the function, must outlive the object
+ */
+void defineNewBuiltinFunction(Environment& env, const BuiltinDescriptor& descriptor)
+{
+  Object* func{newBuiltinFunction(descriptor)};
+  define(env, newSymbol(descriptor.name), func);
+}
+
+/**
+ * Setup an environment with all builtin functions and syntax.
+ * @param env the environment in which to define the operations
+ */
+void setupEnvironment(Environment& env)
+{
+  for (const BuiltinDescriptor& descriptor : syntaxDescriptors) {
+    defineNewSyntax(env, descriptor);
+  }
+  for (const BuiltinDescriptor& descriptor : builtinFunctionDescriptors) {
+    defineNewBuiltinFunction(env, descriptor);
+  }
 }
 
-}  // namespace scm
\ No newline at end of file
+}  // namespace scm
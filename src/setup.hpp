@@ -7,16 +7,8 @@
 
 namespace scm {
 
-void defineNewSyntax(Environment& env,
-                     std::string name,
-                     int nArgs,
-                     FunctionTag tag,
-                     std::string helpText);
-void defineNewBuiltinFunction(Environment& env,
-                              std::string name,
-                              int nArgs,
-                              FunctionTag tag,
-                              std::string helpText);
+void defineNewSyntax(Environment& env, const BuiltinDescriptor& descriptor);
+void defineNewBuiltinFunction(Environment& env, const BuiltinDescriptor& descriptor);
 void setupEnvironment(Environment& env);
 
 }  // namespace scm
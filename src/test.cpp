@@ -5,6 +5,7 @@
 #include <iostream>
 #include <loguru.hpp>
 #include "evaluate.hpp"
+#include "garbage_collection.hpp"
 #include "memory.hpp"
 #include "operations.hpp"
 #include "parse.hpp"
@@ -15,7 +16,7 @@
 namespace scm {
 
 // Environment used for this testing
-static Environment testEnv{};
+static Environment* testEnv{NULL};
 
 // helpers
 
@@ -45,7 +46,7 @@ Object* evaluateString(const std::string& inputString)
   try {
     std::stringstream ss = std::stringstream(inputString);
     Object* expression = readInput(&ss, true);
-    Object* value = trampoline::evaluateExpression(testEnv, expression);
+    Object* value = trampoline::evaluateExpression(*testEnv, expression);
     return value;
   }
   catch (const schemeException& e) {
@@ -140,7 +141,8 @@ void testExpression(const std::string& inputString, Object* expectedOutput, std:
 void runTests(const Environment& env)
 {
   // setup environment for testing
-  testEnv = env;
+  testEnv = new Environment(env);
+  addRootEnvironment(testEnv);
 
   // parsing
   testExpression("15", 15, "test | parser: integer");
@@ -170,6 +172,24 @@ void runTests(const Environment& env)
   evaluateString("(define (minus1 x) (- x 1))");
   testExpression("(minus1 3)", 2, "test | syntax: define shorthand lambdas");
 
+  evaluateString("(define (make-adder n) (lambda (x) (+ x n)))");
+  testExpression("((make-adder 5) 10)", 15, "test | syntax: closures capture enclosing frames");
+  testExpression(
+      "((lambda (x) (define y (* x 2)) (+ x y)) 3)", 9, "test | syntax: internal define");
+  evaluateString(
+      "(define (analyzed x) (define y 1) (set! y (+ y x)) (if (> y 2) (begin y) 'small))");
+  testExpression("(analyzed 5)", 6, "test | syntax: analyzed lambda bodies");
+  testExpression("(analyzed 0)", "small", "test | syntax: analyzed quote");
+  evaluateString("(define (empty-list? l) (eq? l '()))");
+  testExpression("(empty-list? 1)", SCM_FALSE, "test | syntax: empty list in lambda body");
+  evaluateString("(define (car-or-empty l) (if (cons? l) (car l) '()))");
+  testExpression(
+      "(empty-list? (car-or-empty 5))", SCM_TRUE, "test | syntax: empty list in analyzed if");
+  evaluateString("(define (global-callee) 1)");
+  evaluateString("(define (global-caller) (global-callee))");
+  evaluateString("(define (global-callee) 2)");
+  testExpression("(global-caller)", 2, "test | syntax: redefined globals are seen by callers");
+
   // quote
   testExpression("(quote 1)", 1, "test | syntax: quote single value");
   testExpression("(quote 1 2 3)", 1, "test | syntax: quote first value");
@@ -219,11 +239,14 @@ void runTests(const Environment& env)
   testExpression("(> 2 2)", SCM_FALSE, "test | func: greater than false");
   testExpression("(< 1 2)", SCM_TRUE, "test | func: lesser than true");
   testExpression("(< 4 2)", SCM_FALSE, "test | func: lesser than false");
+  testExpression("(< 1.5 2.5)", SCM_TRUE, "test | func: lesser than float");
   testExpression("(= 2 2)", SCM_TRUE, "test | func: equal number integer");
   testExpression("(= 2.0 2.0)", SCM_TRUE, "test | func: equal number float");
   testExpression("(= 2.0 2)", SCM_TRUE, "test | func: equal number mixed");
   testExpression("(eq? nil nil)", SCM_TRUE, "test | func: eq? true");
-  testExpression("(eq? 1 1)", SCM_FALSE, "test | func: eq? false");
+  testExpression("(eq? 1 1)", SCM_TRUE, "test | func: eq? fixnum true");
+  testExpression("(eq? 1.5 1.5)", SCM_FALSE, "test | func: eq? false");
+  testExpression("(eq? 'abc 'abc)", SCM_TRUE, "test | func: eq? interned symbols");
   testExpression("(equal? 1 1)", SCM_TRUE, "test | func: equal? integer true");
   testExpression("(equal? 1.0 1.0)", SCM_TRUE, "test | func: equal? float true");
   testExpression("(equal? 1.0 1)", SCM_TRUE, "test | func: equal? mixed true");
@@ -242,7 +265,14 @@ void runTests(const Environment& env)
   testExpression("(cons? '(1 2 3))", SCM_TRUE, "test | func: is cons true");
   testExpression("(cons? 1)", SCM_FALSE, "test | func: is cons false");
 
+  // garbage collection
+  testExpression("(cons? (gc-stats))", SCM_TRUE, "test | func: gc-stats");
+  testExpression("(cons? (heap-census))", SCM_TRUE, "test | func: heap-census");
+
   // TODO: to be continued ...
+
+  // the test environment is garbage from now on
+  removeRootEnvironment(testEnv);
 }
 
 }  // namespace scm
\ No newline at end of file
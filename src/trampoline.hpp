@@ -1,7 +1,8 @@
 #pragma once
+#include <algorithm>
 #include <loguru.hpp>
 #include <stack>
-#include <variant>
+#include <vector>
 #include "environment.hpp"
 #include "memory.hpp"
 #include "scheme.hpp"
@@ -9,11 +10,36 @@
 namespace scm {
 namespace trampoline {
 
-// define a stack that can hold multiple different types of values objects!
-// the values contained are the arguments used within our functions, as it's impossible
-// to pass arguments per function call with our implementation of trampoline
-using ArgumentTypeVariant = std::variant<Object*, Environment*, Continuation*, std::size_t, int>;
-extern std::stack<ArgumentTypeVariant> argumentStack;
+/**
+ * The locals a continuation hands on to the next part of its computation, as it's impossible to
+ * pass arguments per function call with our implementation of trampoline. Every continuation
+ * uses the same fixed layout, documented per function: usually the environment, the expression
+ * being evaluated and the expressions that follow it. Builtin functions only use the count.
+ */
+struct Frame {
+  Environment* env;
+  Object* expression;
+  Object* rest{NULL};
+  int count{0};
+};
+
+/**
+ * The frames of all continuations waiting for their turn. Frames are pushed and popped in place,
+ * no memory is allocated once the stack has grown to the depth of the evaluation.
+ */
+extern std::vector<Frame> frameStack;
+
+/**
+ * The evaluated arguments of the function calls in progress, the first argument of a call lies
+ * deepest. The memory only ever grows, popped values stay in place until they're overwritten, so
+ * builtin functions can read their arguments right where they are.
+ */
+struct ValueStack {
+  std::vector<Object*> values;
+  // the number of values on the stack, values[size - 1] is the topmost one
+  std::size_t size;
+};
+extern ValueStack valueStack;
 
 // this is the stack on which we push the next functions to call
 extern FunctionStack functionStack;
@@ -24,62 +50,126 @@ extern Object* lastReturnValue;
 
 // forward declarations
 Object* trampoline(Continuation* startFunction);
-Continuation* tCall(Continuation* nextFunc,
-                    Continuation* nextPart = NULL,
-                    std::vector<ArgumentTypeVariant> arguments = {});
-Continuation* tCall(Continuation* nextFunc, std::vector<ArgumentTypeVariant> arguments = {});
-Continuation* tReturn(Object* value);
 void initializeEvaluationStacks();
-void pushArg(ArgumentTypeVariant arg);
-void pushArgs(std::vector<ArgumentTypeVariant> arguments);
-Continuation* popFunc();
-void pushFunc(Continuation* nextFunc);
-void printArg(ArgumentTypeVariant arg, std::string prefix = "", std::string postfix = "");
-void printArgStack();
+void printFrameStack();
 
 /**
- * Pops and returns the topmost element of the argument stack. Implemented because
- * the member `pop` function of std::stack doesn't return the popped value
- * @returns the popped argument, can be of any type in ArgumentType Variant
+ * Pops the next function from the function stack
+ * @returns a pointer to the next function
  */
-template <typename T>
-T popArg()
+inline Continuation* popFunc()
 {
-  if (argumentStack.empty()) {
-    schemeThrow("trying to pop argument from empty stack");
+  if (functionStack.empty()) {
+    schemeThrow("could not pop from function stack!");
   }
-  printArg(argumentStack.top(),
-           "popping",
-           "into " + std::string(typeid(T).name()) + " [" + std::to_string(argumentStack.size()) +
-               "->" + std::to_string(argumentStack.size() - 1) + ']');
-  T arg{std::get<T>(argumentStack.top())};
-  argumentStack.pop();
-  return arg;
+  DLOG_IF_F(INFO,
+            LOG_STACK_TRACE,
+            "pop function [%d->%d]",
+            static_cast<int>(functionStack.size()),
+            static_cast<int>(functionStack.size() - 1));
+  Continuation* nextFunc{functionStack.top()};
+  functionStack.pop();
+  return nextFunc;
 }
 
 /**
- * Pops and returns the topmost N elements of the argument stack
- * @param n the amount of values popped
- * @returns the popped objects in a vector of the specified type
+ * Pushes a function on the function stack
+ * @param nextFunc the function pointer to push on the stack
  */
-template <typename T>
-std::vector<T> popArgs(int n)
+inline void pushFunc(Continuation* nextFunc)
 {
-  DLOG_IF_F(INFO, LOG_STACK_TRACE, "popping %d values from stack", n);
-  if (argumentStack.size() < n) {
-    printArgStack();
-    schemeThrow("stack doesn't contain " + std::to_string(n) + " arguments!");
-  }
-  std::vector<T> values;
-  try {
-    for (int i{0}; i < n; i++) {
-      values.push_back(popArg<T>());
-    }
-  }
-  catch (std::bad_variant_access& e) {
-    schemeThrow("argument on argument stack isn't of the chosen type");
+  DLOG_IF_F(INFO,
+            LOG_STACK_TRACE,
+            "push function : %d -> %d",
+            static_cast<int>(functionStack.size()),
+            static_cast<int>(functionStack.size() + 1));
+  functionStack.push(nextFunc);
+}
+
+/**
+ * Pushes the locals of a continuation onto the frame stack.
+ * @param frame the locals, can be specified as {env, expression, rest, count}
+ */
+inline void pushFrame(const Frame& frame)
+{
+  frameStack.push_back(frame);
+}
+
+/**
+ * Pops the locals of the running continuation from the frame stack.
+ * @returns the frame that was pushed for it
+ */
+inline Frame popFrame()
+{
+  DCHECK_F(!frameStack.empty(), "trying to pop a frame from an empty stack");
+  Frame frame{frameStack.back()};
+  frameStack.pop_back();
+  return frame;
+}
+
+/**
+ * Pushes an evaluated argument onto the value stack.
+ * @param value the value of the argument
+ */
+inline void pushValue(Object* value)
+{
+  if (valueStack.size == valueStack.values.size()) {
+    valueStack.values.resize(std::max<std::size_t>(64, 2 * valueStack.size));
   }
-  return values;
+  valueStack.values[valueStack.size++] = value;
+}
+
+/**
+ * Pops the topmost value of the value stack.
+ * @returns the most recently pushed value
+ */
+inline Object* popValue()
+{
+  DCHECK_F(valueStack.size > 0, "trying to pop a value from an empty stack");
+  return valueStack.values[--valueStack.size];
+}
+
+/**
+ * Pops the topmost n values of the value stack without copying them. They stay where they are
+ * until the next value is pushed, which is enough for a builtin function to read its arguments.
+ * @param n the number of values
+ * @returns a pointer to the first of the values, the one that was pushed first
+ */
+inline Object** popValues(int n)
+{
+  DLOG_IF_F(INFO, LOG_STACK_TRACE, "popping %d values from stack", n);
+  DCHECK_F(valueStack.size >= static_cast<std::size_t>(n), "stack doesn't contain %d values", n);
+  valueStack.size -= n;
+  return valueStack.values.data() + valueStack.size;
+}
+
+/**
+ * Return the next function to run, push the function after the next one to the stack
+ * and push the locals for the next function to the stack.
+ * @param nextFunc the next function to call
+ * @param nextPart the continuation of the current function
+ * @param frame the locals of the next function
+ * @returns a pointer to the next function
+ */
+inline Continuation* tCall(Continuation* nextFunc, Continuation* nextPart, const Frame& frame)
+{
+  pushFrame(frame);
+  pushFunc(nextPart);
+  return nextFunc;
 }
+
+/**
+ * Return the next function to run and push the locals for the next function to the stack.
+ * @overload
+ * @param nextFunc the next function to call
+ * @param frame the locals of the next function
+ * @returns a pointer to the next function
+ */
+inline Continuation* tCall(Continuation* nextFunc, const Frame& frame)
+{
+  pushFrame(frame);
+  return nextFunc;
+}
+
 }  // namespace trampoline
 }  // namespace scm
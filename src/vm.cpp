@@ -0,0 +1,387 @@
+#include "vm.hpp"
+#include <loguru.hpp>
+#include <string>
+#include <vector>
+#include "compile.hpp"
+#include "environment.hpp"
+#include "evaluate.hpp"
+#include "garbage_collection.hpp"
+#include "memory.hpp"
+#include "operations.hpp"
+#include "scheme.hpp"
+#include "trampoline.hpp"
+
+namespace scm {
+namespace vm {
+
+/**
+ * the calls of compiled code in progress.
+ */
+std::vector<CallFrame> callStack;
+
+// evaluate expressions with the virtual machine instead of the trampoline
+static bool enabled{false};
+
+// jump from instruction to instruction through a table of labels where the compiler allows it
+static bool threadedDispatch{SCM_THREADED_DISPATCH};
+
+/**
+ * Is the virtual machine used to evaluate expressions?
+ * @returns true if it was enabled
+ */
+bool isEnabled()
+{
+  return enabled;
+}
+
+/**
+ * Choose the engine evaluateExpression uses from now on. Functions created by one engine can be
+ * called by the other one.
+ * @param useVirtualMachine true for the virtual machine, false for the trampoline
+ */
+void setEnabled(bool useVirtualMachine)
+{
+  enabled = useVirtualMachine;
+}
+
+/**
+ * Choose how the virtual machine dispatches its instructions, mainly to compare the two.
+ * Threaded dispatch is only available if the compiler supports labels as values.
+ * @param threaded true to jump from instruction to instruction, false to use a switch
+ * @returns whether threaded dispatch is used from now on
+ */
+bool setThreadedDispatch(bool threaded)
+{
+  threadedDispatch = threaded && SCM_THREADED_DISPATCH;
+  return threadedDispatch;
+}
+
+/**
+ * Enable the virtual machine if `--vm` was passed on the command line. The option is removed
+ * from the arguments, so the remaining ones can be handled as if it had never been there.
+ * @param argc the number of command line arguments, updated
+ * @param argv the command line arguments, updated
+ */
+void configureEvaluation(int& argc, char** argv)
+{
+  int nKept{1};
+  for (int i{1}; i < argc; i++) {
+    if (std::string(argv[i]) == "--vm") {
+      enabled = true;
+    }
+    else {
+      argv[nKept++] = argv[i];
+    }
+  }
+  argc = nKept;
+  DLOG_IF_F(INFO, LOG_EVALUATION, "evaluating with the %s", enabled ? "vm" : "trampoline");
+}
+
+/**
+ * Get the compiled body of a user defined function, it's compiled on the first call if the
+ * function was created by the trampoline.
+ * @param function the user defined function
+ * @returns the bytecode object
+ */
+static Object* getCode(Object* function)
+{
+  UserFuncValue& callee{static_cast<UserFuncObject*>(function)->value};
+  if (callee.code == NULL) {
+    callee.code = compileFunction(function);
+    writeBarrier(function, callee.code);
+  }
+  return callee.code;
+}
+
+/**
+ * Create the frame of a call of a user defined function and store the arguments in its slots.
+ * The arguments and the function itself are popped from the value stack. Surplus arguments are
+ * ignored, just like evaluateUserDefinedFunction does.
+ * @param function the user defined function, right below its arguments on the value stack
+ * @param code the compiled body of the function
+ * @param nArgs the number of arguments on the value stack
+ * @throw schemeException if too few arguments were passed
+ * @returns the frame
+ */
+static Environment* newCallFrame(Object* function, Object* code, int nArgs)
+{
+  const UserFuncValue& callee{static_cast<UserFuncObject*>(function)->value};
+  int nParameters{static_cast<BytecodeObject*>(code)->value.nArgs};
+  if (nArgs < nParameters) {
+    schemeThrow("to few arguments passed to function, type `(help fname)` for more information");
+  }
+  Environment* frame{newEnvironment(callee.env, callee.slotNames, callee.frameSize)};
+  Object** arguments{trampoline::popValues(nArgs)};
+  for (int slot{0}; slot < nParameters; slot++) {
+    setSlot(*frame, {NULL, 0, slot}, arguments[slot]);
+  }
+  trampoline::popValue();
+  return frame;
+}
+
+/**
+ * Find the name of a slot for an error message.
+ * @param code the code referring to the slot
+ * @param slot the index of the slot
+ * @returns the name of the local variable
+ */
+static std::string getSlotName(Object* code, int slot)
+{
+  Object* name{getBytecode(code).slotNames};
+  for (; slot > 0 && hasTag(name, TAG_CONS); slot--) {
+    name = getCdr(name);
+  }
+  return hasTag(name, TAG_CONS) ? toString(getCar(name)) : std::to_string(slot);
+}
+
+// taking the address of a label is a GNU extension, so is jumping to such an address
+#if SCM_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/**
+ * The loop of the virtual machine, runs the innermost call of the call stack and every call it
+ * makes until it returns. Values are kept on the value stack of the trampoline, so the garbage
+ * collector finds them and builtin functions take their arguments right from there. The only
+ * safepoints are calls, everything alive is on the value stack or in a call frame then.
+ * With threaded dispatch, every instruction jumps straight to the next one through a table of
+ * label addresses instead of going back to the switch. Each instruction ends in an indirect
+ * jump of its own that way, so the branch predictor learns which instruction tends to follow
+ * which one, while a single switch shares one jump among all of them.
+ * @tparam threaded dispatch through the table of labels, ignored where it isn't supported
+ * @param baseDepth the number of calls below the one to run
+ * @returns the result of the call
+ */
+template <bool threaded>
+static Object* runLoop(std::size_t baseDepth)
+{
+  using trampoline::popValue;
+  using trampoline::pushValue;
+  using trampoline::valueStack;
+
+  // the state of the innermost call, kept in locals while it runs
+  CallFrame* frame{&callStack.back()};
+  const Instruction* pc{frame->pc};
+  Object* const* constants{static_cast<BytecodeObject*>(frame->code)->value.constants.data()};
+  Environment* env{frame->env};
+
+#if SCM_THREADED_DISPATCH
+  // indexed by the instructions, in the order of OpCode
+  [[maybe_unused]] static const void* const dispatchTable[]{
+      &&label_OP_CONSTANT,
+      &&label_OP_LOCAL,
+      &&label_OP_OUTER_LOCAL,
+      &&label_OP_GLOBAL,
+      &&label_OP_VARIABLE,
+      &&label_OP_DEFINE,
+      &&label_OP_SET,
+      &&label_OP_CLOSURE,
+      &&label_OP_POP,
+      &&label_OP_JUMP,
+      &&label_OP_JUMP_IF_FALSE,
+      &&label_OP_CALL,
+      &&label_OP_TAIL_CALL,
+      &&label_OP_RETURN,
+      &&label_OP_EVALUATE,
+  };
+  static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == OP_EVALUATE + 1,
+                "every instruction needs an entry in the dispatch table");
+// the switch is only used to dispatch the first instruction
+#define VM_CASE(op) \
+  case op:          \
+  label_##op:
+#define VM_NEXT()                          \
+  if constexpr (threaded) {                \
+    instruction = *pc++;                   \
+    goto* dispatchTable[instruction.op];   \
+  }                                        \
+  break
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() break
+#endif
+
+  Instruction instruction;
+  while (true) {
+    instruction = *pc++;
+    switch (instruction.op) {
+      VM_CASE(OP_CONSTANT)
+        pushValue(constants[instruction.operand]);
+        VM_NEXT();
+      VM_CASE(OP_LOCAL) {
+        Object* value{getSlot(*env, {NULL, 0, instruction.operand})};
+        if (value == NULL) {
+          schemeThrow("undefined variable: " + getSlotName(frame->code, instruction.operand));
+        }
+        pushValue(value);
+        VM_NEXT();
+      }
+      VM_CASE(OP_OUTER_LOCAL) {
+        Object* reference{constants[instruction.operand]};
+        Object* value{getSlot(*env, getLocalRef(reference))};
+        if (value == NULL) {
+          schemeThrow("undefined variable: " + toString(reference));
+        }
+        pushValue(value);
+        VM_NEXT();
+      }
+      VM_CASE(OP_GLOBAL) {
+        Object* cell{constants[instruction.operand]};
+        Object* value{static_cast<GlobalCellObject*>(cell)->value.value};
+        if (value == NULL) {
+          schemeThrow("undefined variable: " + toString(cell));
+        }
+        pushValue(value);
+        VM_NEXT();
+      }
+      VM_CASE(OP_VARIABLE) {
+        Object* symbol{constants[instruction.operand]};
+        Object* value{getVariable(*env, symbol)};
+        if (value == NULL) {
+          schemeThrow("undefined variable: " + getStringValue(symbol));
+        }
+        pushValue(value);
+        VM_NEXT();
+      }
+      VM_CASE(OP_DEFINE)
+        define(*env, constants[instruction.operand], popValue());
+        pushValue(SCM_VOID);
+        VM_NEXT();
+      VM_CASE(OP_SET)
+        set(*env, constants[instruction.operand], valueStack.values[valueStack.size - 1]);
+        VM_NEXT();
+      VM_CASE(OP_CLOSURE) {
+        Object* code{constants[instruction.operand]};
+        const BytecodeValue& lambda{static_cast<BytecodeObject*>(code)->value};
+        pushValue(newUserFunction(lambda.argList, lambda.bodyList, lambda.slotNames, *env, code));
+        VM_NEXT();
+      }
+      VM_CASE(OP_POP)
+        popValue();
+        VM_NEXT();
+      VM_CASE(OP_JUMP)
+        pc = static_cast<BytecodeObject*>(frame->code)->value.instructions.data() +
+             instruction.operand;
+        VM_NEXT();
+      VM_CASE(OP_JUMP_IF_FALSE) {
+        Object* condition{popValue()};
+        if (condition == SCM_FALSE || (condition != SCM_TRUE && !trampoline::isTrue(condition))) {
+          pc = static_cast<BytecodeObject*>(frame->code)->value.instructions.data() +
+               instruction.operand;
+        }
+        VM_NEXT();
+      }
+      VM_CASE(OP_CALL)
+      VM_CASE(OP_TAIL_CALL)
+      {
+        int nArgs{instruction.operand};
+        Object* function{valueStack.values[valueStack.size - static_cast<std::size_t>(nArgs) - 1]};
+        switch (getTag(function)) {
+          case TAG_FUNC_USER: {
+            Object* code{getCode(function)};
+            Environment* callEnv{newCallFrame(function, code, nArgs)};
+            CallFrame call{code, getBytecode(code).instructions.data(), callEnv};
+            // a call in tail position replaces the current one, so loops run in constant space
+            if (instruction.op == OP_TAIL_CALL) {
+              callStack.back() = call;
+            }
+            else {
+              frame->pc = pc;
+              callStack.push_back(call);
+            }
+            frame = &callStack.back();
+            pc = frame->pc;
+            constants = static_cast<BytecodeObject*>(code)->value.constants.data();
+            env = callEnv;
+            collectGarbageIfDue();
+            break;
+          }
+          case TAG_FUNC_BUILTIN: {
+            const BuiltinDescriptor& descriptor{getBuiltinDescriptor(function)};
+            // the operand is the arity, so binary arithmetic can go straight to its fast path
+            if (nArgs == 2 && descriptor.binaryFastPath) {
+              Object* result{descriptor.binaryFastPath(valueStack.values[valueStack.size - 2],
+                                                       valueStack.values[valueStack.size - 1])};
+              if (result) {
+                valueStack.size -= 2;
+                valueStack.values[valueStack.size - 1] = result;
+                break;
+              }
+            }
+            frame->pc = pc;
+            Object* result{trampoline::applyBuiltinFunction(function, nArgs)};
+            valueStack.values[valueStack.size - 1] = result;
+            break;
+          }
+          case TAG_SYNTAX:
+            schemeThrow(toString(function) +
+                        " became syntax after the expression using it was compiled");
+          // like the trampoline, anything else that's applied is its own result
+          default:
+            valueStack.size -= static_cast<std::size_t>(nArgs);
+            break;
+        }
+        VM_NEXT();
+      }
+      VM_CASE(OP_RETURN)
+        callStack.pop_back();
+        if (callStack.size() == baseDepth) {
+          return popValue();
+        }
+        frame = &callStack.back();
+        pc = frame->pc;
+        constants = static_cast<BytecodeObject*>(frame->code)->value.constants.data();
+        env = frame->env;
+        VM_NEXT();
+      VM_CASE(OP_EVALUATE)
+        frame->pc = pc;
+        pushValue(trampoline::interpretExpression(*env, constants[instruction.operand]));
+        VM_NEXT();
+      default:
+        schemeThrow("unknown instruction " + std::to_string(instruction.op));
+    }
+  }
+}
+
+#undef VM_CASE
+#undef VM_NEXT
+#if SCM_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * Run the innermost call of the call stack with the dispatch chosen by setThreadedDispatch.
+ * @param baseDepth the number of calls below the one to run
+ * @returns the result of the call
+ */
+static Object* run(std::size_t baseDepth)
+{
+  return threadedDispatch ? runLoop<true>(baseDepth) : runLoop<false>(baseDepth);
+}
+
+/**
+ * Evaluate an expression with the virtual machine: it's compiled, then the code is run.
+ * If an error occurs, the calls and values of this evaluation are removed from the stacks.
+ * @param env the environment used for the evaluation
+ * @param expression the expression to be evaluated
+ * @returns the result of the expression
+ */
+Object* evaluateExpression(Environment& env, Object* expression)
+{
+  Object* code{compileExpression(expression, env)};
+  std::size_t baseDepth{callStack.size()};
+  std::size_t nValues{trampoline::valueStack.size};
+  callStack.push_back({code, getBytecode(code).instructions.data(), &env});
+  try {
+    return run(baseDepth);
+  }
+  catch (...) {
+    callStack.erase(callStack.begin() + static_cast<long>(baseDepth), callStack.end());
+    trampoline::valueStack.size = nValues;
+    throw;
+  }
+}
+
+}  // namespace vm
+}  // namespace scm
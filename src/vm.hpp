@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include "environment.hpp"
+#include "scheme.hpp"
+
+// gcc and clang support labels as values, which the virtual machine uses for threaded dispatch
+#if defined(__GNUC__)
+#define SCM_THREADED_DISPATCH 1
+#else
+#define SCM_THREADED_DISPATCH 0
+#endif
+
+namespace scm {
+namespace vm {
+
+/**
+ * A call of compiled code that's in progress: the code, the instruction to continue with once
+ * the calls it made have returned and the frame holding its local variables.
+ */
+struct CallFrame {
+  Object* code;
+  const Instruction* pc;
+  Environment* env;
+};
+
+/**
+ * The calls in progress, the innermost one last. Their values live on the value stack of the
+ * trampoline, which is how builtin functions find their arguments.
+ */
+extern std::vector<CallFrame> callStack;
+
+bool isEnabled();
+void setEnabled(bool enabled);
+bool setThreadedDispatch(bool threaded);
+void configureEvaluation(int& argc, char** argv);
+Object* evaluateExpression(Environment& env, Object* expression);
+
+}  // namespace vm
+}  // namespace scm